@@ -0,0 +1,218 @@
+/////////////////////////////////////////////////////////////////
+// APPLESINGLE.C
+// AppleSingle (RFC 1740) wrapping of attachments, so they keep
+// their ProDOS file type and aux type
+// Shared between attacher.c and email.c
+/////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <apple2_filetype.h>
+
+#include "applesingle.h"
+
+#define AS_DATA   1     // Entry IDs
+#define AS_NAME   3
+#define AS_PRODOS 11
+
+enum as_state {AS_HDR, AS_BODY, AS_RAW};
+
+static const uint8_t magic[] = {0x00, 0x05, 0x16, 0x00,   // AppleSingle
+                                0x00, 0x02, 0x00, 0x00};  // Version 2
+
+/*
+ * Read big endian 32 bit value
+ */
+static uint32_t get32(uint8_t *p) {
+  return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+         ((uint16_t)p[2] << 8) | p[3];
+}
+
+/*
+ * Write big endian 32 bit value
+ */
+static void put32(uint8_t *p, uint32_t v) {
+  p[0] = v >> 24;
+  p[1] = v >> 16;
+  p[2] = v >> 8;
+  p[3] = v;
+}
+
+/*
+ * Write one entry of the entry table
+ */
+static void put_entry(uint8_t *p, uint8_t id, uint32_t off, uint32_t len) {
+  put32(p, id);
+  put32(p + 4, off);
+  put32(p + 8, len);
+}
+
+/*
+ * Build the AppleSingle header for a file with only a data fork.
+ * The data fork follows straight after the header.
+ * p - buffer of at least AS_WRAPSZ bytes
+ * name - ProDOS file name
+ * type, aux - ProDOS file type and aux type
+ * size - length of data fork
+ * Returns length of header
+ */
+uint16_t as_header(uint8_t *p, char *name, uint8_t type, uint16_t aux,
+                   uint32_t size) {
+  uint8_t l = strlen(name);
+  uint16_t off = 26 + 3 * 12;
+  memset(p, 0, 26);
+  memcpy(p, magic, 8);
+  p[25] = 3;                              // Three entries
+  put_entry(p + 26, AS_NAME, off, l);
+  put_entry(p + 38, AS_PRODOS, off + l, 8);
+  put_entry(p + 50, AS_DATA, off + l + 8, size);
+  memcpy(p + off, name, l);
+  off += l;
+  p[off] = 0;                             // Access: destroy, rename, write, read
+  p[off + 1] = 0xc3;
+  p[off + 2] = 0;                         // File type
+  p[off + 3] = type;
+  put32(p + off + 4, aux);                // Aux type
+  return off + 8;
+}
+
+/*
+ * Start unwrapping an AppleSingle file
+ * a - state to set up
+ * fp - file to write the data fork to, already created. It is created
+ *      again once the file type is known.
+ * name - path of fp
+ */
+void as_begin(struct applesingle *a, FILE *fp, char *name) {
+  a->fp = fp;
+  strncpy(a->name, name, 79);
+  a->name[79] = '\0';
+  a->pos = a->infopos = a->datapos = a->dataend = 0;
+  memset(a->info, 0, sizeof(a->info));
+  a->hdrlen = 0;
+  a->need = 26;
+  a->state = AS_HDR;
+}
+
+/*
+ * Create the output file again with the ProDOS file type and aux type,
+ * before any of the data fork is written to it
+ */
+static void as_settype(struct applesingle *a) {
+  if (!a->infopos || !a->fp)
+    return;
+  fclose(a->fp);
+  unlink(a->name);
+  _filetype = a->info[3];
+  _auxtype = (a->info[6] << 8) | a->info[7];
+  a->fp = fopen(a->name, "wb");
+  a->infopos = 0;
+}
+
+/*
+ * Parse the header and entry table in hdr[]
+ * Only the data fork and ProDOS file info entries are used. The file info
+ * is only used if it comes before the data fork, as the file type must be
+ * known before any of the data fork is written.
+ */
+static void as_parse(struct applesingle *a) {
+  uint8_t *e;
+  uint16_t i, n = (a->hdr[24] << 8) | a->hdr[25];
+  if (a->hdrlen == 26) {
+    if (memcmp(a->hdr, magic, 4) || (n > AS_MAXENT)) {
+      a->state = AS_RAW;          // Not AppleSingle, save as is
+      return;
+    }
+    a->need = 26 + 12 * n;
+    if (n)
+      return;
+  }
+  for (i = 0; i < n; ++i) {
+    e = a->hdr + 26 + 12 * i;
+    switch (get32(e)) {
+    case AS_DATA:
+      a->datapos = get32(e + 4);
+      a->dataend = a->datapos + get32(e + 8);
+      break;
+    case AS_PRODOS:
+      if (get32(e + 8) >= 8)
+        a->infopos = get32(e + 4);
+      break;
+    }
+  }
+  if (a->infopos + 8 > a->datapos)
+    a->infopos = 0;
+  a->state = AS_BODY;
+}
+
+/*
+ * Unwrap the next n bytes of AppleSingle data
+ * The ProDOS file info is picked out as it goes past, and the data fork
+ * is written to the output file. Everything else is skipped.
+ * If the data is not AppleSingle after all it is written unchanged.
+ * Returns 0 if okay, 1 on write error
+ */
+uint8_t as_write(struct applesingle *a, uint8_t *p, uint16_t n) {
+  uint32_t off;
+  uint16_t i, l;
+  while (n) {
+    l = n;
+    switch (a->state) {
+    case AS_HDR:
+      if (l > a->need - a->hdrlen)
+        l = a->need - a->hdrlen;
+      memcpy(a->hdr + a->hdrlen, p, l);
+      a->hdrlen += l;
+      if (a->hdrlen == a->need) {
+        as_parse(a);
+        if ((a->state == AS_RAW) &&
+            (fwrite(a->hdr, 1, a->hdrlen, a->fp) != a->hdrlen))
+          return 1;
+      }
+      break;
+    case AS_BODY:
+      if (a->pos < a->datapos) {
+        if (a->datapos - a->pos < l)
+          l = a->datapos - a->pos;
+        for (i = 0; i < l; ++i) {
+          off = a->pos + i - a->infopos;
+          if (a->infopos && (off < 8))
+            a->info[off] = p[i];
+        }
+      } else if (a->pos < a->dataend) {
+        as_settype(a);
+        if (a->dataend - a->pos < l)
+          l = a->dataend - a->pos;
+        if (!a->fp || (fwrite(p, 1, l, a->fp) != l))
+          return 1;
+      }
+      break;
+    case AS_RAW:
+      if (fwrite(p, 1, l, a->fp) != l)
+        return 1;
+      break;
+    }
+    a->pos += l;
+    p += l;
+    n -= l;
+  }
+  return 0;
+}
+
+/*
+ * Finish unwrapping an AppleSingle file and close the output file
+ * Returns 0 if okay, 1 if the output file could not be created
+ */
+uint8_t as_end(struct applesingle *a) {
+  if (a->state == AS_BODY)
+    as_settype(a);  // In case the data fork is empty
+  if (!a->fp)
+    return 1;
+  if (a->state == AS_HDR) // Too short for AppleSingle, save as is
+    fwrite(a->hdr, 1, a->hdrlen, a->fp);
+  fclose(a->fp);
+  a->fp = NULL;
+  return 0;
+}
@@ -0,0 +1,42 @@
+/////////////////////////////////////////////////////////////////
+// APPLESINGLE.H
+// AppleSingle (RFC 1740) wrapping of attachments, so they keep
+// their ProDOS file type and aux type
+// Shared between attacher.c and email.c
+/////////////////////////////////////////////////////////////////
+
+#ifndef _APPLESINGLE_H_
+#define _APPLESINGLE_H_
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define AS_MAXENT  8                      // Max entries understood
+#define AS_HDRSZ   (26 + 12 * AS_MAXENT)  // Header and entry table
+#define AS_WRAPSZ  (26 + 3 * 12 + 15 + 8) // Largest header as_header() writes
+
+// MIME type for AppleSingle
+#define AS_MIMETYPE "application/applefile"
+
+// State of an AppleSingle file being unwrapped
+struct applesingle {
+  FILE     *fp;            // File the data fork is written to
+  char     name[80];       // Path of that file
+  uint32_t pos;            // Offset in the AppleSingle data
+  uint32_t infopos;        // Offset of ProDOS file info, 0 if none
+  uint32_t datapos;        // Offset of data fork
+  uint32_t dataend;        // Offset of end of data fork
+  uint16_t hdrlen;         // Bytes collected in hdr[]
+  uint16_t need;           // Bytes of hdr[] needed before going on
+  uint8_t  state;
+  uint8_t  info[8];        // ProDOS file info entry
+  uint8_t  hdr[AS_HDRSZ];
+};
+
+uint16_t as_header(uint8_t *p, char *name, uint8_t type, uint16_t aux,
+                   uint32_t size);
+void as_begin(struct applesingle *a, FILE *fp, char *name);
+uint8_t as_write(struct applesingle *a, uint8_t *p, uint16_t n);
+uint8_t as_end(struct applesingle *a);
+
+#endif
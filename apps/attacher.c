@@ -11,7 +11,10 @@
 #include <stdint.h>
 #include <string.h>
 #include <unistd.h>
+#include <apple2_filetype.h>
 #include "email_common.h"
+#include "codec.h"
+#include "applesingle.h"
 
 #define PROMPT_ROW 23
 
@@ -29,6 +32,9 @@
 #define LINEBUFSZ 1000         // According to RFC2822 Section 2.1.1 (998+CRLF)
 #define READSZ    1024         // Must be less than NETBUFSZ to fit in buf[]
 #define IOBUFSZ   8192
+#define ENCINSZ   (57 * 56)    // Attachment bytes encoded per block. 57 bytes
+                               // make one line of base64, so the 4312 bytes of
+                               // output fit in iobuf[] after the input.
 
 unsigned char buf[NETBUFSZ+1];    // One extra byte for null terminator
 char          linebuf[LINEBUFSZ];
@@ -36,6 +42,7 @@ char          userentry[80];
 uint8_t       quit_to_email;   // If 1, launch EMAIL.SYSTEM on quit
 char          filename[80];
 char          iobuf[IOBUFSZ];
+char          boundary[72];    // MIME boundary used for attachments
 
 struct attachinfo {
   char     filename[16];
@@ -158,13 +165,18 @@ void readconfigfile(void) {
  * Returns number of chars in the line, or 0 if EOF.
  * Expects Apple ][ style line endings (CR) and does no conversion
  * fp - file to read from
+ * reset - if 1 then just reset the buffer and return
  * writep - Pointer to buffer into which line will be written
  * n - length of buffer. Longer lines will be truncated and terminated with CR.
  */
-uint16_t get_line(FILE *fp, char *writep, uint16_t n) {
+uint16_t get_line(FILE *fp, uint8_t reset, char *writep, uint16_t n) {
   static uint16_t rd = 0; // Read
   static uint16_t end = 0; // End of valid data in buf
   uint16_t i = 0;
+  if (reset) {
+    rd = end = 0;
+    return 0;
+  }
   while (1) {
     if (rd == end) {
       end = fread(buf, 1, READSZ, fp);
@@ -185,51 +197,6 @@ done:
   return i;
 }
 
-/*
- * Base64 encode table
- */
-static const char b64enc[] =
-  "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
-
-/*
- * Encode Base64 format
- * p - Pointer to source buffer
- * q - Pointer to destination buffer
- * len - Length of buffer to encode
- * Returns length of encoded data
- */
-uint16_t encode_base64(char *p, char *q, uint16_t len) {
-  uint16_t j = 0;
-  uint16_t i, ii;
-  for (i = 0; i < len / 3; ++i) {
-    ii = 3 * i;
-    q[j++] = b64enc[(p[ii] & 0xfc) >> 2];
-    q[j++] = b64enc[((p[ii] & 0x03) << 4) | ((p[ii + 1] & 0xf0) >> 4)];
-    q[j++] = b64enc[((p[ii + 1] & 0x0f) << 2) | ((p[ii + 2] & 0xc0) >> 6)];
-    q[j++] = b64enc[(p[ii + 2] & 0x3f)];
-    if (((i + 1) % 18) == 0)
-      q[j++] = '\r';
-  }
-  ii += 3;
-  i = len - ii; // Bytes remaining to encode
-  switch (i) {
-  case 1:
-    q[j++] = b64enc[(p[ii] & 0xfc) >> 2];
-    q[j++] = b64enc[(p[ii] & 0x03) << 4];
-    q[j++] = '=';
-    q[j++] = '=';
-    break;
-  case 2:
-    q[j++] = b64enc[(p[ii] & 0xfc) >> 2];
-    q[j++] = b64enc[((p[ii] & 0x03) << 4) | ((p[ii + 1] & 0xf0) >> 4)];
-    q[j++] = b64enc[(p[ii + 1] & 0x0f) << 2];
-    q[j++] = '=';
-    break;
-  }
-  q[j] = '\0';
-  return j;
-}
-
 /*
  * Prompt for a name in the bottom line of the screen
  * Returns number of chars read.
@@ -641,51 +608,174 @@ char *shortfilename(char *fullfilename) {
   return fullfilename + lastslash + 1;
 }
 
+/*
+ * Copy up to n bytes from the current position in fp to destfp, in blocks
+ * of IOBUFSZ bytes
+ * size - bytes copied so far, for the spinner
+ * Returns the new value of size
+ */
+uint32_t copy_bytes(FILE *fp, FILE *destfp, uint32_t n, uint32_t size) {
+  uint16_t i;
+  while (n) {
+    i = fread(iobuf, 1, (n < IOBUFSZ ? n : IOBUFSZ), fp);
+    if (i == 0)
+      break;
+    if (fwrite(iobuf, 1, i, destfp) != i)
+      error(ERR_FATAL, "Can't write TMPFILE");
+    n -= i;
+    size += i;
+    spinner(size, 0);
+  }
+  return size;
+}
+
+/*
+ * Find the closing delimiter "--boundary--" of a multipart message.
+ * It is normally right at the end, so the last READSZ bytes are checked
+ * first. Failing that, the whole body is searched a line at a time.
+ * hdrend - offset of the start of the body
+ * Returns offset of the last closing delimiter line, or 0 if none.
+ */
+uint32_t find_close(FILE *fp, uint32_t hdrend) {
+  static char delim[76];
+  uint32_t pos, found = 0;
+  uint16_t i, n, len;
+  len = sprintf(delim, "--%s--", boundary);
+  fseek(fp, 0, SEEK_END);
+  pos = ftell(fp);
+  pos = (pos - hdrend > READSZ) ? pos - READSZ : hdrend;
+  fseek(fp, pos, SEEK_SET);
+  n = fread(buf, 1, READSZ, fp);
+  // First byte is only known to start a line if it starts the body
+  for (i = (pos == hdrend ? 0 : 1); i + len <= n; ++i)
+    if (((i == 0) || (buf[i - 1] == '\r')) && !memcmp(buf + i, delim, len))
+      found = pos + i;
+  if (found)
+    return found;
+  pos = hdrend;
+  fseek(fp, pos, SEEK_SET);
+  get_line(fp, 1, NULL, 0); // Reset buffer
+  while ((n = get_line(fp, 0, linebuf, LINEBUFSZ)) != 0) {
+    if (!strncmp(linebuf, delim, len))
+      found = pos;
+    pos += n;
+  }
+  return found;
+}
+
+/*
+ * Get ready to write the first attachment
+ * If the message is already multipart and its closing delimiter was
+ * found, the attachments overwrite the closing delimiter in place.
+ * Anything after it was epilogue, which MIME readers ignore anyway.
+ * Otherwise the message is block copied to OUTBOX/TMPFILE, adding the
+ * MIME wrapper after the headers if it is not multipart yet.
+ * fp - the message, open for update
+ * hdrlen - length of the headers, not counting the blank line
+ * hdrend - offset of the start of the body
+ * closepos - offset of closing delimiter, or 0 if none
+ * Returns the file to write the attachments to
+ */
+FILE *start_attachments(FILE *fp, uint32_t hdrlen, uint32_t hdrend,
+                        uint32_t closepos) {
+  FILE *destfp;
+  uint32_t size;
+  if (closepos) {
+    fseek(fp, closepos, SEEK_SET);
+    return fp;
+  }
+  snprintf(filename, 80, "%s/OUTBOX/TMPFILE", cfg_emaildir);
+  _filetype = PRODOS_T_TXT;
+  _auxtype = 0;
+  destfp = fopen(filename, "wb");
+  if (!destfp)
+    error(ERR_FATAL, "Can't open TMPFILE");
+  printf("  Copying email content ...  "); // Space is for spinner to eat
+  fseek(fp, 0, SEEK_SET);
+  if (boundary[0])
+    size = copy_bytes(fp, destfp, 0xffffffffUL, 0);
+  else {
+    size = copy_bytes(fp, destfp, hdrlen, 0);
+    strcpy(boundary, "a2forever");
+    fprintf(destfp, "MIME-Version: 1.0\r");
+    fprintf(destfp, "Content-Type: multipart/mixed; boundary=%s\r\r", boundary);
+    fprintf(destfp, "This is a multi-part message in MIME format.\r");
+    fprintf(destfp, "--%s\r", boundary);
+    fprintf(destfp, "Content-Type: text/plain; charset=US-ASCII\r");
+    fprintf(destfp, "Content-Transfer-Encoding: 7bit\r\r");
+    fseek(fp, hdrend, SEEK_SET);
+    size = copy_bytes(fp, destfp, 0xffffffffUL, size);
+  }
+  spinner(size, 1);
+  return destfp;
+}
+
+/*
+ * Look up the ProDOS file type and aux type of a file in its directory
+ * path - full path of the file
+ * name - file name part of path
+ * type, aux - set to BIN, 0 if the file is not found
+ */
+void get_file_type(char *path, char *name, uint8_t *type, uint16_t *aux) {
+  DIR *dp;
+  struct dirent *d;
+  *type = PRODOS_T_BIN;
+  *aux = 0;
+  if (name == path)
+    dp = opendir(".");
+  else {
+    name[-1] = '\0';
+    dp = opendir(path);
+    name[-1] = '/';
+  }
+  if (!dp)
+    return;
+  while (d = readdir(dp)) {
+    if (!strcasecmp(d->d_name, name)) {
+      *type = d->d_type;
+      *aux = d->d_auxtype;
+      break;
+    }
+  }
+  closedir(dp);
+}
+
 /*
  * Optionally attach files to outgoing email.
+ * Nothing is written until the first attachment is chosen.
  * filename - Name of file containing email message
  */
 void attach(char *fname) {
-  FILE *fp, *fp2, *destfp;
-  uint16_t chars, i;
-  uint32_t size;
+  FILE *fp, *fp2, *destfp = NULL;
+  uint16_t chars, i, aux;
+  uint32_t size, hdrlen, hdrend = 0, closepos = 0;
   char *s, c;
   struct attachinfo *a;
   struct attachinfo *latest = NULL;
-  uint8_t attachcount = 0;
+  uint8_t attachcount = 0, applefile, type;
   videomode(VIDEOMODE_80COL);
   printf("%c%s ATTACHER%c\n\n", 0x0f, PROGNAME, 0x0e);
   fp = fopen(fname, "rb+");
   if (!fp)
     error(ERR_FATAL, "Can't open %s", fname);
-  snprintf(filename, 80, "%s/OUTBOX/TMPFILE", cfg_emaildir);
-  _filetype = PRODOS_T_TXT;
-  _auxtype = 0;
-  destfp = fopen(filename, "wb");
-  if (!destfp)
-    error(ERR_FATAL, "Can't open TMPFILE");
 
-  printf("  Copying email content ...  "); // Space is for spinner to eat
-  size = 0;
-  while ((chars = get_line(fp, linebuf, LINEBUFSZ)) != 0) {
-    size += chars;
+  boundary[0] = '\0';
+  get_line(fp, 1, NULL, 0); // Reset buffer
+  while ((chars = get_line(fp, 0, linebuf, LINEBUFSZ)) != 0) {
+    hdrend += chars;
     if (linebuf[0] == '\r')
       break;
-    fputs(linebuf, destfp);
-    spinner(size, 0);
-  }
-  fprintf(destfp, "MIME-Version: 1.0\r");
-  fprintf(destfp, "Content-Type: multipart/mixed; boundary=a2forever\r\r");
-  fprintf(destfp, "This is a multi-part message in MIME format.\r");
-  fprintf(destfp, "--a2forever\r");
-  fprintf(destfp, "Content-Type: text/plain; charset=US-ASCII\r");
-  fprintf(destfp, "Content-Transfer-Encoding: 7bit\r\r");
-  while ((chars = get_line(fp, linebuf, LINEBUFSZ)) != 0) {
-    size += chars;
-    fputs(linebuf, destfp);
-    spinner(size, 0);
+    // Forward as attachment in EMAIL.SYSTEM creates a multipart message
+    if (!strncmp(linebuf, "Content-Type: multipart/mixed; boundary=", 40)) {
+      strncpy(boundary, linebuf + 40, 71);
+      boundary[71] = '\0';
+      if (s = strchr(boundary, '\r'))
+        *s = '\0';
+    }
   }
-  spinner(size, 1);
+  hdrlen = (chars ? hdrend - 1 : hdrend);
+  if (boundary[0])
+    closepos = find_close(fp, hdrend);
 
   while (1) {
     cursor(0);
@@ -706,12 +796,13 @@ void attach(char *fname) {
       a = a->next;
     }
     gotoxy(0, 21);
-    printf("%c A)dd attachment | D)one with attachments |                                     %c", INVERSE, NORMAL);
+    printf("%c A)dd attachment | P)roDOS attachment, keeps file type | D)one with attachments %c", INVERSE, NORMAL);
 ask:
     c = cgetc();
     if ((c == 'D') || (c == 'd'))
       goto done;
-    if ((c != 'A') && (c != 'a')) {
+    applefile = ((c == 'P') || (c == 'p'));
+    if ((c != 'A') && (c != 'a') && !applefile) {
       beep();
       goto ask;
     }
@@ -743,19 +834,34 @@ ask:
       printf(linebuf);
       continue;
     }
-    fprintf(destfp, "\r--a2forever\r");
-    fprintf(destfp, "Content-Type: application/octet-stream\r");
+    if (!destfp)
+      destfp = start_attachments(fp, hdrlen, hdrend, closepos);
+    fprintf(destfp, "\r--%s\r", boundary);
+    fprintf(destfp, "Content-Type: %s\r",
+            (applefile ? AS_MIMETYPE : "application/octet-stream"));
     fprintf(destfp, "Content-Transfer-Encoding: base64\r");
     fprintf(destfp, "Content-Disposition: attachment; filename=%s;\r\r", s);
     printf("  Attaching '%s' ...  ", userentry); // Space is for spinner to eat
+    // AppleSingle header goes in front of the file data in the first block
+    chars = 0;
+    if (applefile) {
+      get_file_type(userentry, s, &type, &aux);
+      fseek(fp2, 0, SEEK_END);
+      size = ftell(fp2);
+      fseek(fp2, 0, SEEK_SET);
+      chars = as_header(iobuf, s, type, aux, size);
+    }
     size = 0;
     do {
-      i = fread(buf, 1, 72 * 3 / 4 * 5, fp2); // Multiple of 72*3/4 bytes
+      i = fread(iobuf + chars, 1, ENCINSZ - chars, fp2);
       size += i;
+      i += chars;
+      chars = 0;
       if (i == 0)
         break;
-      i = encode_base64(buf, buf + READSZ / 2, i);
-      i = fwrite(buf + READSZ / 2, 1, i, destfp);
+      i = encode_base64(iobuf, iobuf + ENCINSZ, i);
+      if (fwrite(iobuf + ENCINSZ, 1, i, destfp) != i)
+        error(ERR_FATAL, "Can't write attachment");
       spinner(size, 0);
     } while (!feof(fp2));
     fclose(fp2);
@@ -772,8 +878,11 @@ ask:
     latest->next = NULL;
   }
 done:
-  fprintf(destfp, "\r--a2forever--\r");
+  if (destfp)
+    fprintf(destfp, "\r--%s--\r", boundary);
   fclose(fp);
+  if (!destfp || (destfp == fp))
+    return;
   fclose(destfp);
   if (unlink(fname))
     error(ERR_FATAL, "Can't delete %s", fname);
@@ -0,0 +1,205 @@
+; Base64 encoder for the enhanced Apple //e
+; Used by the attacher. Other targets use the C version in codec.c.
+; Each group of three bytes is encoded with no shifting or masking at
+; run time, using page-aligned lookup tables.
+
+.export _encode_base64
+.import popax
+.importzp ptr1, ptr2, ptr3, tmp1, tmp2, tmp3, tmp4
+
+b0	= tmp1			; Bytes of the group being encoded
+b1	= tmp2
+b2	= tmp3
+inidx	= tmp4			; Index into current input line
+outidx	= ptr3			; Index into current output line
+
+; uint16_t __fastcall__ encode_base64(char *p, char *q, uint16_t len)
+; Encodes len bytes from p into q as base64, null terminated.
+; Every 57 input bytes make one 76 char line, which is ended with CR.
+; Returns number of chars written, not counting the null.
+_encode_base64:
+	sta len
+	stx len+1
+	jsr popax			; q
+	sta ptr2
+	stx ptr2+1
+	sta qstart
+	stx qstart+1
+	jsr popax			; p
+	sta ptr1
+	stx ptr1+1
+
+	; Whole lines
+line:	lda len+1
+	bne full
+	lda len
+	cmp #57
+	bcc tail
+full:	lda #19				; 19 groups of 3 bytes per line
+	jsr groups
+	lda #$0d			; Y is 76
+	sta (ptr2),y
+	clc
+	lda ptr1
+	adc #57
+	sta ptr1
+	bcc :+
+	inc ptr1+1
+:	clc
+	lda ptr2
+	adc #77
+	sta ptr2
+	bcc :+
+	inc ptr2+1
+:	sec
+	lda len
+	sbc #57
+	sta len
+	bcs line
+	dec len+1
+	bra line
+
+	; Last part line, A is bytes left (0-56)
+tail:	ldx #$ff			; Divide by 3
+	sec
+:	inx
+	sbc #3
+	bcs :-
+	adc #3				; Carry is clear, A is remainder
+	sta rem
+	txa
+	jsr groups
+	lda rem
+	beq done
+
+	; One or two bytes left over, padded with '='
+	ldy inidx
+	lda (ptr1),y
+	sta b0
+	stz b1
+	stz b2
+	lda rem
+	cmp #2
+	bne :+
+	iny
+	lda (ptr1),y
+	sta b1
+:	lda #1
+	sta count
+	jsr emit
+	lda #$3d			; '='
+	dey
+	sta (ptr2),y
+	ldx rem
+	cpx #2
+	beq done
+	dey
+	sta (ptr2),y
+
+	; Null terminate and work out the length
+done:	ldy outidx
+	lda #$00
+	sta (ptr2),y
+	tya
+	clc
+	adc ptr2
+	sta ptr2
+	bcc :+
+	inc ptr2+1
+:	sec
+	lda ptr2
+	sbc qstart
+	pha
+	lda ptr2+1
+	sbc qstart+1
+	tax
+	pla
+	rts
+
+; Encode A groups of three bytes from (ptr1) to (ptr2)
+; Leaves inidx and outidx just past the last group, and Y = outidx.
+groups:	stz inidx
+	stz outidx
+	sta count
+	tax
+	bne gloop
+	rts
+gloop:	ldy inidx
+	lda (ptr1),y
+	sta b0
+	iny
+	lda (ptr1),y
+	sta b1
+	iny
+	lda (ptr1),y
+	sta b2
+	iny
+	sty inidx
+emit:	ldy outidx
+	ldx b0
+	lda e0,x			; b0 >> 2
+	sta (ptr2),y
+	iny
+	lda lo2,x			; (b0 & $03) << 4 | b1 >> 4
+	ldx b1
+	ora hi4,x
+	tax
+	lda b64enc,x
+	sta (ptr2),y
+	iny
+	ldx b1
+	lda lo4,x			; (b1 & $0f) << 2 | b2 >> 6
+	ldx b2
+	ora hi6,x
+	tax
+	lda b64enc,x
+	sta (ptr2),y
+	iny
+	ldx b2
+	lda e3,x			; b2 & $3f
+	sta (ptr2),y
+	iny
+	sty outidx
+	dec count
+	bne gloop
+	rts
+
+; Base64 char for a value 0-63
+.define B64(v) ((v) < 26) * ($41 + (v)) + ((v) >= 26 && (v) < 52) * ($61 - 26 + (v)) + ((v) >= 52 && (v) < 62) * ($30 - 52 + (v)) + ((v) = 62) * $2b + ((v) = 63) * $2f
+
+.rodata
+	.align 256
+e0:				; Char for top six bits of a byte
+	.repeat 256, i
+	.byte B64(i >> 2)
+	.endrepeat
+e3:				; Char for bottom six bits of a byte
+	.repeat 256, i
+	.byte B64(i & $3f)
+	.endrepeat
+lo2:				; Bottom two bits, moved up four
+	.repeat 256, i
+	.byte (i & $03) << 4
+	.endrepeat
+hi4:				; Top four bits, moved down four
+	.repeat 256, i
+	.byte i >> 4
+	.endrepeat
+lo4:				; Bottom four bits, moved up two
+	.repeat 256, i
+	.byte (i & $0f) << 2
+	.endrepeat
+hi6:				; Top two bits, moved down six
+	.repeat 256, i
+	.byte i >> 6
+	.endrepeat
+b64enc:
+	.repeat 64, i
+	.byte B64(i)
+	.endrepeat
+
+.bss
+len:	.res 2				; Bytes still to encode
+qstart:	.res 2				; Start of output, for the length
+count:	.res 1				; Groups left to encode
+rem:	.res 1				; Bytes left over after whole groups
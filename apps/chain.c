@@ -0,0 +1,72 @@
+/////////////////////////////////////////////////////////////////
+// CHAIN.C
+// Running POP65, SMTP65, NNTP65 and NNTP65UP back to back from
+// SYNC65, bringing up the network only once
+/////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <apple2_filetype.h>
+
+#include "../inc/ip65.h"
+#include "chain.h"
+
+#define NETFILE "SYNC.NET" // Network settings from SYNC65
+
+static char *phases[] = {"POP65", "SMTP65", "NNTP65", "NNTP65UP"};
+
+/*
+ * Save the network settings obtained by SYNC65
+ * The W5100 keeps its configuration when the next program is loaded,
+ * so it only needs to be told the same settings again.
+ */
+void chain_net_save(uint8_t eth_init) {
+  FILE *fp;
+  _filetype = PRODOS_T_BIN;
+  _auxtype = 0;
+  fp = fopen(NETFILE, "wb");
+  if (!fp)
+    return;
+  fwrite(&eth_init, 1, 1, fp);
+  fwrite(&cfg_ip, sizeof(cfg_ip), 1, fp);
+  fwrite(&cfg_netmask, sizeof(cfg_netmask), 1, fp);
+  fwrite(&cfg_gateway, sizeof(cfg_gateway), 1, fp);
+  fclose(fp);
+}
+
+/*
+ * Load the network settings saved by SYNC65, in place of
+ * ip65_init() and dhcp_init()
+ * Returns 1 if the settings were loaded, 0 otherwise
+ */
+uint8_t chain_net_load(uint8_t *eth_init) {
+  FILE *fp;
+  uint8_t ok;
+  fp = fopen(NETFILE, "rb");
+  if (!fp)
+    return 0;
+  ok = (fread(eth_init, 1, 1, fp) == 1) &&
+       (fread(&cfg_ip, sizeof(cfg_ip), 1, fp) == 1) &&
+       (fread(&cfg_netmask, sizeof(cfg_netmask), 1, fp) == 1) &&
+       (fread(&cfg_gateway, sizeof(cfg_gateway), 1, fp) == 1);
+  fclose(fp);
+  return ok;
+}
+
+/*
+ * Load and run the given phase of a SYNC65 run
+ * Only returns after the last phase, or if the program can't be run.
+ * instdir - Directory where the programs are installed
+ * phase   - Phase to run, CHAIN_END when finished
+ * email   - 1 to return to EMAIL.SYSTEM at the end
+ */
+void chain_exec(char *instdir, uint8_t phase, uint8_t email) {
+  static char path[80];
+  if (phase < CHAIN_END) {
+    snprintf(path, 80, "%s/%s.SYSTEM", instdir, phases[phase]);
+    exec(path, (email ? "SYNC EMAIL" : "SYNC"));
+  }
+  unlink(NETFILE);
+}
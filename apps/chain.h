@@ -0,0 +1,23 @@
+/////////////////////////////////////////////////////////////////
+// CHAIN.H
+// Running POP65, SMTP65, NNTP65 and NNTP65UP back to back from
+// SYNC65, bringing up the network only once
+/////////////////////////////////////////////////////////////////
+
+#ifndef _CHAIN_H_
+#define _CHAIN_H_
+
+#include <stdint.h>
+
+// Phases of a SYNC65 run, in the order they are run
+#define CHAIN_POP       0
+#define CHAIN_SMTP      1
+#define CHAIN_NNTP_DOWN 2
+#define CHAIN_NNTP_UP   3
+#define CHAIN_END       4
+
+void chain_net_save(uint8_t eth_init);
+uint8_t chain_net_load(uint8_t *eth_init);
+void chain_exec(char *instdir, uint8_t phase, uint8_t email);
+
+#endif
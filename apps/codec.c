@@ -0,0 +1,335 @@
+/////////////////////////////////////////////////////////////////
+// CODEC.C
+// MIME decoding shared between email.c, pop65.c, nntp65.c and
+// rebuild.c, and base64 encoding for attacher.c
+/////////////////////////////////////////////////////////////////
+
+#include <ctype.h>
+#include <stdint.h>
+#include <string.h>
+#include "codec.h"
+
+/*
+ * Base64 decode table
+ */
+const int8_t b64dec[] =
+  {62,-1,-1,-1,63,52,53,54,55,56,
+   57,58,59,60,61,-1,-1,-1,-2,-1,
+   -1,-1, 0, 1, 2, 3, 4, 5, 6, 7,
+    8, 9,10,11,12,13,14,15,16,17,
+   18,19,20,21,22,23,24,25,-1,-1,
+   -1,-1,-1,-1,26,27,28,29,30,31,
+   32,33,34,35,36,37,38,39,40,41,
+   42,43,44,45,46,47,48,49,50,51};
+
+/*
+ * Decode Base64 format in place
+ * Each line of base64 has up to 76 chars, which decodes to up to 57 bytes
+ * p - Pointer to buffer to decode. Results written in place.
+ * Returns number of bytes decoded
+ */
+uint16_t decode_base64(char *p) {
+  uint16_t i = 0, j = 0;
+  const int8_t *b = b64dec - 43;
+  while (p[i] && (p[i] != '\r') && (p[i] != '?')) {
+    p[j++] = b[p[i]] << 2 | b[p[i + 1]] >> 4;
+    if (p[i + 2] != '=')
+      p[j++] = b[p[i + 1]] << 4 | b[p[i + 2]] >> 2;
+    if (p[i + 3] != '=')
+      p[j++] = b[p[i + 2]] << 6 | b[p[i + 3]];
+    i += 4;
+  }
+  p[j] = '\0';
+  return j;
+}
+
+/*
+ * Convert hex char to value
+ */
+static uint8_t hexdigit(char c) {
+  if ((c >= '0') && (c <= '9'))
+    return c - '0';
+  else
+    return (c & 0xdf) - 'A' + 10;
+}
+
+/*
+ * Decode buffer from quoted-printable format in place
+ * p - Pointer to buffer to decode. Results written in place.
+ * Returns number of bytes decoded
+ */
+uint16_t decode_quoted_printable(uint8_t *p) {
+  uint16_t i = 0, j = 0;
+  uint8_t c;
+  while (c = p[i]) {
+    if (c == '=') {
+      if (p[i + 1] == '\r') // Trailing '=' is a soft '\r'
+        break;
+      // Otherwise '=xx' where x is a hex digit
+      c = 16 * hexdigit(p[i + 1]) + hexdigit(p[i + 2]);
+      p[j++] = c;
+      i += 3;
+    } else {
+      p[j++] = c;
+      ++i;
+    }
+  }
+  p[j] = '\0';
+  return j;
+}
+
+// Character sets of header text
+// CS_OTHER is any charset we cannot show beyond its ASCII subset
+enum charset {CS_UTF8, CS_LATIN1, CS_OTHER};
+
+// ASCII approximations of ISO-8859-1 chars $C0-$FF
+static const char latin1[] =
+  "AAAAAAACEEEEIIIIDNOOOOOxOUUUUYTs"
+  "aaaaaaaceeeeiiiidnooooo/ouuuuyty";
+
+static char    ew[80];   // Text of encoded-word being decoded
+static char    *dp;      // Where decode_header() writes next char
+static uint8_t room;     // Space remaining at dp
+static uint8_t last_ew;  // 1 if the last thing decoded was an encoded-word
+static uint8_t esc;      // In an ISO 2022 escape sequence
+static uint8_t dbl;      // ISO 2022 two byte mode, 1 or 2 for byte number
+
+/*
+ * ASCII approximation of an ISO-8859-1 / Windows-1252 char >= $80
+ */
+static char latin1_char(uint8_t c) {
+  if (c >= 0xc0)
+    return latin1[c - 0xc0];
+  switch (c) {
+  case 0xa0:
+    return ' ';
+  case 0x91:
+  case 0x92:
+    return '\'';
+  case 0x93:
+  case 0x94:
+    return '"';
+  case 0x96:
+  case 0x97:
+    return '-';
+  }
+  return '#';
+}
+
+/*
+ * Append one char to the output of decode_header()
+ */
+static void emit(char c) {
+  if (room) {
+    *dp++ = c;
+    --room;
+  }
+}
+
+/*
+ * Append one byte of header text to the output, converting it to ASCII
+ * c - byte to convert
+ * cs - character set the byte is in
+ * Multi-byte UTF-8 sequences become one char.
+ */
+static void put_hdr_char(uint8_t c, uint8_t cs) {
+  static uint8_t lead, prev, left;
+  if (c == 0x1b) {               // ISO 2022 escape, eg ESC $ B
+    esc = 1;
+    return;
+  }
+  if (esc) {
+    if (c == '$')
+      dbl = 1;
+    else if (c == '(')
+      dbl = 0;
+    if (c >= 0x30)               // Final byte of escape sequence
+      esc = 0;
+    return;
+  }
+  if (dbl && (c > ' ') && (c < 0x80)) {
+    if (dbl == 1)                // One '#' for each two byte char
+      emit('#');
+    dbl = 3 - dbl;
+    return;
+  }
+  if (c < 0x80) {
+    left = 0;
+    if (c == '\t')
+      emit(' ');
+    else if (c >= ' ')
+      emit(c);
+    return;
+  }
+  if (cs == CS_LATIN1) {
+    emit(latin1_char(c));
+    return;
+  }
+  if (cs == CS_OTHER) {
+    emit('#');
+    return;
+  }
+  if ((c & 0xc0) == 0x80) {      // Continuation byte 10xxxxxx
+    if (left == 0)
+      return;
+    if (--left == 0) {
+      if (lead < 0xc4)           // U+0080 to U+00FF are Latin-1
+        emit(latin1_char(((lead & 0x03) << 6) | (c & 0x3f)));
+      else if ((lead == 0xe2) && (prev == 0x80)) {
+        switch (c) {             // U+2013 to U+201D punctuation
+        case 0x93:
+        case 0x94:
+          emit('-');
+          break;
+        case 0x98:
+        case 0x99:
+          emit('\'');
+          break;
+        case 0x9c:
+        case 0x9d:
+          emit('"');
+          break;
+        default:
+          emit('#');
+        }
+      } else
+        emit('#');
+    }
+    prev = c;
+    return;
+  }
+  lead = c;                      // Lead byte 11xxxxxx
+  prev = 0;
+  left = (c >= 0xf0 ? 3 : (c >= 0xe0 ? 2 : 1));
+}
+
+/*
+ * Identify the charset of an encoded-word
+ * s - charset name, ending in '?'
+ * Returns CS_UTF8, CS_LATIN1 or CS_OTHER
+ */
+static uint8_t header_charset(char *s) {
+  if (!strncasecmp(s, "utf-8?", 6))
+    return CS_UTF8;
+  if (!strncasecmp(s, "iso-8859-1?", 11) ||
+      !strncasecmp(s, "iso-8859-15?", 12) ||
+      !strncasecmp(s, "windows-1252?", 13) ||
+      !strncasecmp(s, "us-ascii?", 9))
+    return CS_LATIN1;
+  return CS_OTHER;
+}
+
+/*
+ * Decode a From or Subject header which may contain RFC 2047
+ * encoded-words (=?charset?B?text?= or =?charset?Q?text?=), appending
+ * plain ASCII to d.
+ * Any number of encoded-words may be mixed with ordinary text. Whitespace
+ * between adjacent encoded-words is dropped, including across a folded
+ * header line when the continuation is appended with another call.
+ * UTF-8, ISO-8859-1, ISO-8859-15 and Windows-1252 text is shown using
+ * the nearest ASCII chars. Other charsets keep their ASCII chars only,
+ * and show '#' for anything else.
+ * d - buffer to append to (must be null terminated)
+ * s - header text, ending in null or CR
+ * n - size of d
+ */
+void decode_header(char *d, char *s, uint8_t n) {
+  char *p, *q;
+  uint8_t l, cs, enc;
+  l = strlen(d);
+  if (l >= n)
+    return;
+  dp = d + l;
+  room = n - 1 - l;
+  if (l && last_ew) {
+    for (p = s; (*p == ' ') || (*p == '\t'); ++p);
+    if ((p[0] == '=') && (p[1] == '?'))
+      s = p;
+  }
+  last_ew = esc = dbl = 0;
+  while (*s && (*s != '\r')) {
+    if ((s[0] == '=') && (s[1] == '?') &&
+        (p = strchr(s + 2, '?')) && p[1] && (p[2] == '?')) {
+      cs = header_charset(s + 2);
+      enc = toupper(p[1]);
+      p += 3;
+      q = strstr(p, "?=");
+      if (!q) // Truncated encoded-word - decode as much as we have
+        for (q = p; *q && (*q != '\r'); ++q);
+      l = (q - p < sizeof(ew) ? q - p : sizeof(ew) - 1);
+      if (enc == 'B')
+        l &= 0xfc; // Whole groups of 4 only
+      memcpy(ew, p, l);
+      ew[l] = '\0';
+      if (enc == 'B')
+        l = decode_base64(ew);
+      else {
+        for (p = ew; *p; ++p)
+          if (*p == '_')
+            *p = ' ';
+        l = decode_quoted_printable(ew);
+      }
+      for (p = ew; l; --l)
+        put_hdr_char(*p++, cs);
+      esc = dbl = 0;
+      s = (*q == '?' ? q + 2 : q);
+      last_ew = 1;
+      // Skip whitespace if another encoded-word follows
+      for (p = s; (*p == ' ') || (*p == '\t'); ++p);
+      if ((p[0] == '=') && (p[1] == '?'))
+        s = p;
+      continue;
+    }
+    put_hdr_char(*s++, CS_UTF8);
+    last_ew = 0;
+  }
+  *dp = '\0';
+}
+
+#ifndef __APPLE2ENH__
+
+/*
+ * Base64 encode table
+ */
+static const char b64enc[] =
+  "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+/*
+ * Encode Base64 format
+ * The enhanced Apple //e uses the faster version in base64.s instead.
+ * Every 57 bytes of input make one 76 char line, which is ended with CR.
+ * p - Pointer to source buffer
+ * q - Pointer to destination buffer
+ * len - Length of buffer to encode
+ * Returns length of encoded data, which is null terminated
+ */
+uint16_t encode_base64(char *p, char *q, uint16_t len) {
+  uint8_t *s = (uint8_t*)p;
+  char *d = q;
+  uint8_t groups = 0;
+  for (; len >= 3; len -= 3, s += 3) {
+    *d++ = b64enc[s[0] >> 2];
+    *d++ = b64enc[((s[0] & 0x03) << 4) | (s[1] >> 4)];
+    *d++ = b64enc[((s[1] & 0x0f) << 2) | (s[2] >> 6)];
+    *d++ = b64enc[s[2] & 0x3f];
+    if (++groups == 19) {
+      *d++ = '\r';
+      groups = 0;
+    }
+  }
+  if (len) {
+    *d++ = b64enc[s[0] >> 2];
+    if (len == 1) {
+      *d++ = b64enc[(s[0] & 0x03) << 4];
+      *d++ = '=';
+    } else {
+      *d++ = b64enc[((s[0] & 0x03) << 4) | (s[1] >> 4)];
+      *d++ = b64enc[(s[1] & 0x0f) << 2];
+    }
+    *d++ = '=';
+  }
+  *d = '\0';
+  return d - q;
+}
+
+#endif
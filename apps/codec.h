@@ -0,0 +1,19 @@
+/////////////////////////////////////////////////////////////////
+// CODEC.H
+// MIME decoding shared between email.c, pop65.c, nntp65.c and
+// rebuild.c, and base64 encoding for attacher.c
+/////////////////////////////////////////////////////////////////
+
+#ifndef _CODEC_H_
+#define _CODEC_H_
+
+#include <stdint.h>
+
+extern const int8_t b64dec[];
+
+uint16_t decode_base64(char *p);
+uint16_t decode_quoted_printable(uint8_t *p);
+void decode_header(char *d, char *s, uint8_t n);
+uint16_t __fastcall__ encode_base64(char *p, char *q, uint16_t len);
+
+#endif
@@ -25,12 +25,14 @@
 #define CURSORROW  10        // Row cursor initially shown on (if enough text)
 #define PROMPT_ROW NROWS + 1 // Row where input prompt is shown
 #define IOSZ       1024      // Size of chunks to use when loading/saving file
+#define SPANSZ     128       // Size of span of gapbuf cached for screen drawing
 #define CUTBUFSZ   8192      // Size of cut buffer. Must be >IOSZ.
 
 #define INFOADDR   0x0800    // Aux mem address for info about buffer
 #define GAPBUFADDR 0x0880    // Aux mem address for gapbuffer itself
 
 #define EOL       '\r'       // ProDOS uses CR line endings
+#define NOROW     65535U     // rowstart[] of rows past the end of the text
 
 #define BELL       0x07
 #define BACKSPACE  0x08
@@ -65,12 +67,22 @@ char    search[80]    = "";
 char    replace[80]   = "";
 char    startdir[80]  = "";
 
-uint8_t rowlen[NROWS];       // Number of chars on each row of screen
+uint8_t  rowlen[NROWS];      // Number of chars on each row of screen
+uint16_t rowstart[NROWS + 1];// Line start cache: position in text of each
+                             // row, and of the row below the screen
+uint8_t  rowdirty[NROWS];    // Dirty map: non-zero if row must be redrawn
+char     rowtext[NCOLS + 1]; // One row of text for putrow80sel()
 
-// Interface to read_char_update_pos()
-uint8_t  do_print;
-uint16_t pos = 0, startsel = 65535U, endsel = 65535U;
-uint8_t  row, col;
+char     spanbuf[SPANSZ];    // Span of gapbuf[] cached for screen drawing
+uint16_t spanstart;          // Index into gapbuf[] of spanbuf[0]
+uint16_t spanlen = 0;        // Number of bytes cached. 0 if invalid.
+
+// Interface to load_gapbuf()
+uint8_t  loadcol;      // Column, for expanding tabs
+uint8_t  loadcr;       // Non-zero if last char loaded was CR, for CRLF
+uint16_t loadlimit;    // Stop loading at next EOL when gapbegin gets here
+
+uint16_t startsel = 65535U, endsel = 65535U;
 
 uint8_t cursrow, curscol; // Cursor position is kept here by draw_screen()
 
@@ -155,6 +167,41 @@ void set_gapbuf(uint16_t i, char c) {
 }
 #pragma code-name (pop)
 
+// Direct output to the 80 column text screen, in video80.s
+void __fastcall__ putrow80(uint8_t row, uint8_t inverse, const char *s);
+void __fastcall__ putrow80sel(uint8_t row, const char *s,
+                              uint8_t first, uint8_t last);
+void __fastcall__ copyrow80(uint8_t dst, uint8_t src);
+
+// Bulk copies between gapbuf[] and main memory, in gapbuf.s
+void __fastcall__ read_gapbuf_span(char *dst, uint16_t i, uint16_t n);
+void __fastcall__ write_gapbuf_span(uint16_t i, char *src, uint16_t n);
+uint16_t __fastcall__ load_gapbuf(char *p, uint16_t n);
+
+/*
+ * Append n bytes from main memory to the gapbuf at current position
+ */
+void append_gapbuf(char *src, uint16_t n) {
+  write_gapbuf_span(gapbegin, src, n);
+  gapbegin += n;
+}
+
+/*
+ * Obtain one byte from the gapbuf[] for screen drawing.
+ * Reads from spanbuf[], refilling it from aux memory when i is outside it.
+ * Callers must set spanlen to 0 before using this after gapbuf[] changed.
+ * i - Index into gapbuf[]
+ * Returns value at gapbuf[i]
+ */
+char get_span(uint16_t i) {
+  if ((uint16_t)(i - spanstart) >= spanlen) {
+    spanstart = i;
+    spanlen = (BUFSZ - i < SPANSZ ? BUFSZ - i : SPANSZ);
+    read_gapbuf_span(spanbuf, i, spanlen);
+  }
+  return spanbuf[i - spanstart];
+}
+
 /*
  * Do a memmove() on aux memory. Uses indices into gapbuf[].
  * Must be in LC
@@ -393,15 +440,6 @@ void clreol(void) {
   gotoxy(x, y);
 }
 
-/*
- * Clear to EOL, wrap to next line
- */
-void clreol_wrap(void) {
-  uint8_t x = wherex();
-  cclear(80 - x);
-  gotox(x);
-}
-
 /*
  * Clear line
  */
@@ -603,13 +641,37 @@ void show_error(char *msg) {
   update_status_line();
 }
 
+/*
+ * Update the line start cache and dirty map for an edit.
+ * The row the edit is on and the one above it are marked dirty, and
+ * the cached start of each row after the edit is moved along.
+ * p - position in text of the edit
+ * n - number of chars inserted (or deleted if negative)
+ */
+void mark_edit(uint16_t p, int8_t n) {
+  uint8_t r, marked = 0;
+  for (r = NROWS + 1; r > 0; --r) {
+    if (rowstart[r - 1] == NOROW)
+      continue;
+    if (rowstart[r - 1] > p)
+      rowstart[r - 1] += n;
+    else if ((marked < 2) && (r - 1 < NROWS)) {
+      rowdirty[r - 1] = 1;
+      ++marked;
+    }
+  }
+  if (marked == 0) // Edit is above the screen
+    memset(rowdirty, 1, NROWS);
+}
+
 /*
  * Insert a character into gapbuf at current position
  * c - character to insert
  */
 void insert_char(char c) {
   if (FREESPACE()) {
-    set_gapbuf(gapbegin++, c);
+    set_gapbuf(gapbegin, c);
+    mark_edit(gapbegin++, 1);
     return;
   }
   beep();
@@ -623,7 +685,7 @@ void delete_char(void) {
     beep();
     return;
   }
-  --gapbegin;
+  mark_edit(--gapbegin, -1);
 }
 
 /*
@@ -635,6 +697,7 @@ void delete_char_right(void) {
     return;
   }
   ++gapend;
+  mark_edit(gapbegin, -1);
 }
 
 /*
@@ -784,60 +847,51 @@ void draw_screen(void);
 #pragma code-name (push, "LC")
 uint8_t load_file(char *fname, uint8_t replace, uint8_t copymode) {
   uint8_t partctr = 0;
-  uint8_t col;
   char *p;
-  uint16_t i, j, s;
-  uint8_t c, cont;
+  uint16_t i, n, s;
+  uint8_t cont;
   FILE *fp = fopen(fname, "r");
   if (!fp)
     return 1;
   if (!replace)
-    col = curscol;
+    loadcol = curscol;
   goto_prompt_row();
   if (replace) {
     gapbegin = 0;
     gapend = BUFSZ - 1;
-    col = 0;
+    loadcol = 0;
   }
+  loadcr = 0;
+  // CR, LF and CRLF are all line endings. Once the buffer gets within
+  // 15000 bytes of full, a large file moves on to the next bank at EOL.
+  loadlimit = ((replace && (banktbl[0] > 1)) ? BUFSZ - 15000 : BUFSZ);
   cutbuflen = 0;
   p = iobuf;
   do {
     spinner(DATASIZE(), 0, copymode);
     s = fread(p, 1, IOSZ, fp);
     cont = (s == IOSZ ? 1 : 0);
-    for (i = 0; i < s; ++i) {
-      switch (p[i]) {
-      case '\r': // Native Apple2 files
-      case '\n': // UNIX files
-        set_gapbuf(gapbegin++, '\r');
-        col = 0;
-        if (replace && (FREESPACE() < 15000) && (banktbl[0] > 1)) {
-          draw_screen();
-          if (open_new_aux_bank(++partctr) == 1) {
-            snprintf(userentry, 80,
-                    "Buffer [%03u] not avail. Truncating file.", l_auxbank + 1);
-            show_error(userentry);
-            if (partctr == 1) // If truncated to one part ...
-              status[2] = 0; // Make it a singleton
-            partctr = 0; // Prevent status[2] increment below
-            goto done;
-          }
-        }
-        break;
-      case '\t':
-        c = next_tabstop(col) - col;
-        for (j = 0; j < c; ++j)
-          set_gapbuf(gapbegin++, ' ');
-        col += c;
-        break;
-      default:
-        set_gapbuf(gapbegin++, p[i]);
-        ++col;
-      }
-      if (FREESPACE() < IOSZ * 2) {
+    for (i = 0; i < s; i += n) {
+      if (FREESPACE() < IOSZ * 2 + 8) {
         show_error("File truncated");
         goto done;
       }
+      n = (FREESPACE() - IOSZ * 2) / 8; // Room even if all are tabs
+      if (n > s - i)
+        n = s - i;
+      n = load_gapbuf(p + i, n);
+      if ((gapbegin >= loadlimit) && (loadcol == 0)) {
+        draw_screen();
+        if (open_new_aux_bank(++partctr) == 1) {
+          snprintf(userentry, 80,
+                  "Buffer [%03u] not avail. Truncating file.", l_auxbank + 1);
+          show_error(userentry);
+          if (partctr == 1) // If truncated to one part ...
+            status[2] = 0; // Make it a singleton
+          partctr = 0; // Prevent status[2] increment below
+          goto done;
+        }
+      }
     }
   } while (cont);
 done:
@@ -846,7 +900,6 @@ done:
     if (partctr > 0)
       status[2] = ++partctr;
     jump_pos(0);
-    pos = 0;
     set_modified(0);
     status[1] = 0; // No need to prompt for overwrite on save
     startsel = endsel = 65535U;
@@ -869,7 +922,7 @@ uint8_t save_file(uint8_t copymode, uint8_t append) {
   uint16_t sz;
   uint8_t retval = 1;
   uint8_t i;
-  uint16_t p, j;
+  uint16_t p;
   FILE *fp;
   _filetype = PRODOS_T_TXT;
   _auxtype = 0;
@@ -886,14 +939,13 @@ uint8_t save_file(uint8_t copymode, uint8_t append) {
     sz = DATASIZE();
   for (i = 0; i < sz / IOSZ; ++i) {
     spinner(i * IOSZ, 1, copymode);
-    for (j = 0; j < IOSZ; ++j)
-      iobuf[j] = get_gapbuf(p++);
+    read_gapbuf_span(iobuf, p, IOSZ);
+    p += IOSZ;
     if (fwrite(iobuf, IOSZ, 1, fp) != 1)
       goto done;
   }
   spinner(i * IOSZ, 1, copymode);
-  for (j = 0; j < sz - (IOSZ * i); ++j)
-    iobuf[j] = get_gapbuf(p++);
+  read_gapbuf_span(iobuf, p, sz - (IOSZ * i));
   if (fwrite(iobuf, sz - (IOSZ * i), 1, fp) != 1)
     goto done;
   retval = 0;
@@ -963,178 +1015,179 @@ done:
 }
 
 /*
- * Read next char from gapbuf[] and update state.
- * Returns 1 on EOL, 0 otherwise
- * If do_print is set, print char on the screen.
- * Interface is via the following globals:
- *  do_print  - if 1, update screen
- *  pos       - position in buffer, advanced by one
- *  row, col  - position on screen
- *  rowlen[]  - length of each screen row in chars
+ * Find where the line containing position p in the text starts
+ * p - position in text, no further on than gapbegin
+ * Returns position of first char of the line
  */
-uint8_t read_char_update_pos(void) {
-  uint16_t delta = gapend - gapbegin;
+uint16_t line_start(uint16_t p) {
+  uint8_t i, n;
+  spanlen = 0;
+  while (p > 0) {
+    // Before gapbegin, position in text is the same as index into gapbuf[]
+    n = (p < SPANSZ ? p : SPANSZ);
+    read_gapbuf_span(spanbuf, p - n, n);
+    for (i = n; i > 0; --i, --p)
+      if (spanbuf[i - 1] == EOL)
+        return p;
+  }
+  return 0;
+}
+
+/*
+ * Find where the screen row containing position p in the text starts
+ * p - position in text, no further on than gapbegin
+ */
+uint16_t row_start(uint16_t p) {
+  uint16_t l = line_start(p);
+  return l + (p - l) / NCOLS * NCOLS;
+}
+
+/*
+ * Find where the screen row above a row starts
+ * p - position in text of first char of a row, not 0
+ */
+uint16_t row_above(uint16_t p) {
+  if (get_gapbuf(p - 1) != EOL) // Row above wrapped, so it is full
+    return p - NCOLS;
+  return row_start(p - 1);
+}
+
+/*
+ * Repaint the rows of the screen that have changed.
+ * Lays out rows from the first dirty row, using the line start cache,
+ * and stops at the first row after the last dirty row that still starts
+ * where it did, because the rest of the screen is then unchanged.
+ * Updates rowstart[], rowlen[], and the cursor position if the cursor
+ * is on a row that was laid out. cursrow is NROWS if the cursor is off
+ * the bottom of the screen.
+ */
+void update_screen(void) {
+  uint16_t p, end = DATASIZE();
   uint16_t s = startsel, e = endsel;
+  uint8_t r, first, last, n, eol, selfirst, sellast;
   char c;
+  spanlen = 0;
   if (startsel > endsel) {
     s = endsel;
     e = startsel;
   }
-  if ((c = get_gapbuf(pos++)) == EOL) {
-    if (do_print) {
-      rowlen[row] = col + 1;
-      clreol_wrap();
-      gotox(0);
+  for (first = 0; (first < NROWS) && !rowdirty[first]; ++first);
+  if (first == NROWS)
+    return;
+  if (startsel != 65535U) // Selection may have moved relative to text
+    memset(rowdirty + first, 1, NROWS - first);
+  for (last = NROWS; !rowdirty[last - 1]; --last);
+  p = rowstart[first];
+  for (r = first; r < NROWS; ++r) {
+    if ((r >= last) && (rowstart[r] == p))
+      goto done;
+    rowstart[r] = p;
+    n = eol = 0;
+    if (p != NOROW) {
+      while ((p < end) && (n < NCOLS)) {
+        c = get_span(p < gapbegin ? p : p + gapend + 1 - gapbegin);
+        ++p;
+        if (c == EOL) {
+          eol = 1;
+          break;
+        }
+        rowtext[n++] = c;
+      }
+      if ((gapbegin >= rowstart[r]) && (gapbegin <= rowstart[r] + n)) {
+        cursrow = r;
+        curscol = gapbegin - rowstart[r];
+      }
+      if (!eol && (n < NCOLS))
+        p = NOROW; // Text ends on this row
     }
-    ++row;
-    col = 0;
-    return 1;
+    rowtext[n] = '\0';
+    rowlen[r] = n + eol;
+    selfirst = sellast = 0;
+    if ((s < rowstart[r] + n) && (e > rowstart[r])) {
+      selfirst = (s > rowstart[r] ? s - rowstart[r] : 0);
+      sellast = (e < rowstart[r] + n ? e - rowstart[r] : n);
+    }
+    putrow80sel(r, rowtext, selfirst, sellast);
+    rowdirty[r] = 0;
   }
-  if (((pos > s) && (pos <= e)) || // Left of cursor 
-      ((pos - delta > s) && (pos - delta - 1 <= e)))   // Right of cursor
-    revers(1);
-  else
-    revers(0);
-  if (do_print)
-    cputc(c);
-  revers(0);
-  ++col;
-  if (do_print)
-    rowlen[row] = col;
-  if (col == NCOLS) {
-    ++row;
-    col = 0;
+  rowstart[NROWS] = p;
+done:
+  if (curscol == NCOLS) { // End of a full row is start of the next one
+    ++cursrow;
+    curscol = 0;
   }
-  return 0;
 }
 
 /*
- * Draw screenful of text
+ * Draw screenful of text, with the cursor on CURSORROW if there is
+ * enough text above it
  */
 void draw_screen(void) {
-  uint16_t startpos;
-  uint8_t rowsabove, cursorrow;
-
-  // Initialize all rows to length 0 to cover those rows that may have
-  // no text and would otherwise be unitialized.
-  for (rowsabove = 0; rowsabove < NROWS; ++rowsabove)
-    rowlen[rowsabove] = 0;
-
-  // First we have to scan back to work out where in the buffer to
-  // start drawing on the screen at the top left. This is at most
-  // CURSORROW * NCOLS chars.
-  startpos = gapbegin;
-  if (startpos > (CURSORROW + 2) * NCOLS)
-    startpos -= (CURSORROW + 2) * NCOLS;
-  else
-    startpos = 0;
-
-  // Format the text and work out the number of rows it takes up
-  pos = startpos;
-  row = col = 0;
-  do_print = 0;
-  while (pos < gapbegin)
-    read_char_update_pos();
-  rowsabove = row; // Number of complete rows above cursor
-
-  if (rowsabove <= CURSORROW) {
-    pos = 0;
-    cursorrow = rowsabove;
-  } else {
-    cursorrow = CURSORROW;
+  uint16_t top = row_start(gapbegin);
+  uint8_t r;
 
-    // Now repeat the formatting of the text, eating the first
-    // (rowsabove - cursorrow) lines
-    pos = startpos;
-    row = col = 0;
-    while (row < (rowsabove - cursorrow))
-      read_char_update_pos();
-  }
+  for (r = 0; (r < CURSORROW) && (top > 0); ++r)
+    top = row_above(top);
 
-  // Finally actually write the text to the screen!
   videomode(VIDEOMODE_80COL);
-  clrscr();
   revers(0);
-  row = col = 0;
-  do_print = 1;
-  while (pos < gapbegin)
-    read_char_update_pos();
-
-  curscol = col;
-  cursrow = row;
-
-  // Now write the text after the cursor up to the end of the screen
-  pos = gapend + 1;
-  while ((pos < BUFSZ) && (row < NROWS))
-    read_char_update_pos();
-
+  rowstart[0] = top;
+  memset(rowdirty, 1, NROWS);
+  update_screen();
+  putrow80(NROWS, 0, "");
   update_status_line();
 }
 
 /*
- * Scroll screen up and update rowlen[]
+ * Scroll screen down by one row, to show the row above the top.
+ * Rows are moved in text page memory and only the new row is drawn.
+ * cursrow is moved down with the text.
  */
-void scroll_up() {
-  draw_screen();
-}
-
-/*
- * Scroll screen down and update rowlen[]
- */
-void scroll_down() {
-  draw_screen();
+void scroll_up(void) {
+  uint8_t r = NROWS - 1, col = curscol;
+  if (rowstart[0] == 0)
+    return;
+  rowstart[NROWS] = rowstart[NROWS - 1];
+  for (; r > 0; --r) {
+    copyrow80(r, r - 1);
+    rowstart[r] = rowstart[r - 1];
+    rowlen[r] = rowlen[r - 1];
+  }
+  rowstart[0] = row_above(rowstart[0]);
+  rowdirty[0] = 1;
+  r = cursrow + 1;
+  update_screen();
+  cursrow = r;
+  curscol = col;
 }
 
 /*
- * Returns 1 if current position in gap buffer is on the last line of
- * the file (ie: no following CR), 0 otherwise
+ * Scroll screen up by one row, to show the row below the bottom.
+ * Rows are moved in text page memory and only the new row is drawn.
+ * cursrow is moved up with the text.
  */
-uint8_t is_last_line(void) {
-  uint16_t p = gapend + 1;
-  while (p < BUFSZ) {
-    if (get_gapbuf(p++) == '\r')
-      return 0;
-  }
-  return 1;
+void scroll_down(void) {
+  uint8_t r, col = curscol;
+  if (rowstart[NROWS] == NOROW)
+    return;
+  for (r = 0; r < NROWS - 1; ++r) {
+    copyrow80(r, r + 1);
+    rowstart[r] = rowstart[r + 1];
+    rowlen[r] = rowlen[r + 1];
+  }
+  rowstart[NROWS - 1] = rowstart[NROWS];
+  rowdirty[NROWS - 1] = 1;
+  r = cursrow - 1;
+  update_screen();
+  cursrow = r;
+  curscol = col;
 }
 
 /*
  * Update screen after delete_char_right()
  */
 void update_after_delete_char_right(void) {
-  uint8_t eol = 0;
-  uint8_t i;
-  col = curscol;
-  row = cursrow;
-  do_print = 1;
-
-  // Print rest of line up to EOL
-  pos = gapend + 1;
-  if (pos == BUFSZ)
-    --rowlen[row];
-  else
-    while (!eol && (pos < BUFSZ) && (row < NROWS)) {
-      i = col;
-      eol = read_char_update_pos();
-    }
-
-  if (is_last_line())
-    clreol_wrap();
-
-  // If necessary, print rest of screen
-  if ((get_gapbuf(gapend) == EOL) || (i == NCOLS - 1)) {
-    while ((pos < BUFSZ) && (row < NROWS))
-      read_char_update_pos();
-
-    clreol_wrap();
-
-    // Erase the rest of the screen (if any)
-    for (i = row + 1; i < NROWS; ++i) {
-      gotoxy(0, i);
-      clrline();
-    }
-  }
-
+  update_screen();
   gotoxy(curscol, cursrow);
   cursor(1);
 }
@@ -1143,70 +1196,11 @@ void update_after_delete_char_right(void) {
  * Update screen after delete_char()
  */
 void update_after_delete_char(void) {
-  uint8_t eol = 0;
-  uint8_t i;
-  col = curscol;
-  row = cursrow;
-
-  if (get_gapbuf(gapbegin) == EOL) {
-    // Special handling if we deleted an EOL
-    if (row > 0)
-      col = rowlen[--row] - 1;
-    else {
-      scroll_up();
-      return;
-    }
-  } else {
-    // Erase char to left of cursor & update row, col
-    gotox(wherex() - 1);
-    cputc(' ');
-    gotox(wherex() - 1);
-    if (col > 0)
-      --col;
-    else {
-      col = NCOLS - 1;
-      if (row > 0)
-        --row;
-      else {
-        scroll_up();
-        return;
-      }
-    }
-  }
-
-  curscol = col;
-  cursrow = row;
-  gotoxy(curscol, cursrow);
-
-  do_print = 1;
-
-  // Print rest of line up to EOL
-  pos = gapend + 1;
-  if (pos == BUFSZ)
-    --rowlen[row];
-  else
-    while (!eol && (pos < BUFSZ) && (row < NROWS)) {
-      i = col;
-      eol = read_char_update_pos();
-    }
-
-  if (is_last_line())
-    clreol_wrap();
-
-  // If necessary, print rest of screen
-  if ((get_gapbuf(gapbegin) == EOL) || (i == NCOLS - 1)) {
-    while ((pos < BUFSZ) && (row < NROWS))
-      read_char_update_pos();
-
-    clreol_wrap();
-
-    // Erase the rest of the screen (if any)
-    for (i = row + 1; i < NROWS; ++i) {
-      gotoxy(0, i);
-      clrline();
-    }
+  if ((cursrow == 0) && (curscol == 0)) { // Deleted char above the screen
+    draw_screen();
+    return;
   }
-
+  update_screen();
   gotoxy(curscol, cursrow);
   cursor(1);
 }
@@ -1215,37 +1209,12 @@ void update_after_delete_char(void) {
  * Update screen after insert_char()
  */
 void update_after_insert_char(void) {
-  uint8_t eol = 0;
-  uint8_t prevcol;
-  col = curscol;
-  row = cursrow;
-
-  // Print character just inserted
-  pos = gapbegin - 1;
-  do_print = 1;
-  read_char_update_pos();
-
-  curscol = col;
-  cursrow = row;
-  gotoxy(curscol, cursrow);
-
-  if (cursrow == NROWS) {
+  update_screen();
+  if ((cursrow == NROWS) || (gapbegin >= rowstart[NROWS])) {
     scroll_down();
-    return;
-  }
-
-  // Print rest of line up to EOL
-  pos = gapend + 1;
-  while (!eol && (pos < BUFSZ) && (row < NROWS)) {
-    prevcol = col;
-    eol = read_char_update_pos();
+    cursrow = NROWS - 1;
+    curscol = gapbegin - rowstart[NROWS - 1];
   }
-
-  // If necessary, print rest of screen
-  if ((get_gapbuf(gapbegin - 1) == EOL) || (prevcol == 0))
-    while ((pos < BUFSZ) && (row < NROWS))
-      read_char_update_pos();
-
   gotoxy(curscol, cursrow);
   cursor(1);
 }
@@ -2459,11 +2428,7 @@ int edit(char *fname) {
       if (endsel - startsel <= CUTBUFSZ) {
         cutbuflen = endsel - startsel;
         jump_pos(startsel);
-        __asm__("lda %v", auxbank); 
-        __asm__("sta $c073");  // Set aux bank
-        copyaux((char*)GAPBUFADDR + gapend + 1, iobuf, cutbuflen, FROMAUX);
-        __asm__("lda #$00");
-        __asm__("sta $c073");  // Set aux bank back to 0
+        read_gapbuf_span(iobuf, gapend + 1, cutbuflen);
       } else {
         cutbuflen = 0;
         if (save_file(1, 0) == 1) {
@@ -2487,14 +2452,9 @@ int edit(char *fname) {
     case 0x16:       // ^V "Paste"
       mode = SEL_NONE;
       mark_undo();
-      if (cutbuflen > 0) {
-        __asm__("lda %v", auxbank); 
-        __asm__("sta $c073");  // Set aux bank
-        copyaux(iobuf, (char*)GAPBUFADDR + gapbegin, cutbuflen, TOAUX);
-        __asm__("lda #$00");
-        __asm__("sta $c073");  // Set aux bank back to 0
-        gapbegin += cutbuflen;
-      } else {
+      if (cutbuflen > 0)
+        append_gapbuf(iobuf, cutbuflen);
+      else {
         if (load_file("CLIPBOARD", 0, 1))
           show_error("Can't open CLIPBOARD");
       }
@@ -18,6 +18,9 @@
 
 #define EMAIL_C
 #include "email_common.h"
+#include "codec.h"
+#include "newsrc.h"
+#include "applesingle.h"
 
 // Program constants
 #define MSGS_PER_PAGE 19     // Number of messages shown on summary screen
@@ -25,6 +28,7 @@
 #define READSZ        512    // Size of buffer for copying files
 #define LINEBUFSZ     1024   // Max line 1000 according to RFC2822 Sect 2.1.1
                              // We use 1024 because this is also used for scrollback
+#define WRAPBLK       1024   // Size of output block for reply/forward body
 
 // Characters
 #define BELL          0x07
@@ -54,6 +58,7 @@ static char email_prefs[]  = "EMAIL.PREFS";
 static char email_db[]     = "%s/%s/EMAIL.DB";
 static char email_db_new[] = "%s/%s/EMAIL.DB.NEW";
 static char next_email[]   = "%s/%s/NEXT.EMAIL";
+static char news_read[]    = "%s/%s/" NEWSRC_READ;
 static char email_file[]   = "%s/%s/EMAIL.%u";
 static char inbox[]        = "INBOX";
 static char outbox[]       = "OUTBOX";
@@ -63,7 +68,6 @@ static char cant_seek[]    = "Can't seek in %s";
 static char cant_malloc[]  = "Can't alloc";
 static char cant_delete[]  = "Can't delete %s";
 static char cant_write[]   = "Can't write to %s";
-static char mime_ver[]     = "MIME-Version: 1.0";
 static char ct[]           = "Content-Type: ";
 static char cte[]          = "Content-Transfer-Encoding: ";
 static char sevenbit[]     = "7bit";
@@ -73,6 +77,7 @@ static char b64[]          = "base64";
 static char unsupp_enc[]   = "** Unsupp encoding %s\n";
 static char sb_err[]       = "Scrollback error";
 static char a2_forever[]   = "%s: %s - Apple II Forever!\r\r";
+static char fwd_delim[]    = "--a2fwd%05u%s\r";
 
 /*
  * Represents a date and time
@@ -102,6 +107,16 @@ static uint16_t          first_msg = 1;   // Msg numr: first message current pag
 static uint8_t           reverse = 0;     // 0 normal, 1 reverse order
 static char              curr_mbox[80] = "INBOX";
 static unsigned char     buf[READSZ];
+static char              rowtext[81];     // One screen row for putrow80()
+static uint8_t           scr_row;         // Pager output position
+static uint8_t           scr_col;
+static char              *wrapblk;        // Output block for word wrapping
+static uint16_t          wrapused;        // Bytes used in wrapblk[]
+static struct newsrc     readset;         // News articles read, by EMAIL.n
+static struct applesingle asf;            // AppleSingle attachment being saved
+
+/* Defined in video80.s */
+void __fastcall__ putrow80(uint8_t row, uint8_t inverse, const char *s);
 
 
 /*
@@ -158,8 +173,23 @@ void load_editor(uint8_t compose) {
 }
 #pragma code-name (pop)
 
-static char *apps[] = {"POP65", "SMTP65", "NNTP65", "NNTP65UP", "DATE65"};
-enum appidx {APP_POP, APP_SMTP, APP_NNTP_DOWN, APP_NNTP_UP, APP_DATE};
+static char *apps[] = {"POP65", "SMTP65", "NNTP65", "NNTP65UP", "DATE65",
+                       "SYNC65", "GROUPS65"};
+enum appidx {APP_POP, APP_SMTP, APP_NNTP_DOWN, APP_NNTP_UP, APP_DATE, APP_SYNC,
+             APP_GROUPS};
+
+/*
+ * Load NNTP65.SYSTEM to download an article from a header-only newsgroup
+ * NNTP65 returns to EMAIL.SYSTEM once the article is in the mailbox.
+ */
+#pragma code-name (push, "LC")
+void fetch_article(uint16_t num) {
+  save_prefs();
+  snprintf(userentry, 80, "%s GET %s %u", email, curr_mbox, num);
+  snprintf(filename, 80, "%s/%s.SYSTEM", cfg_instdir, apps[APP_NNTP_DOWN]);
+  exec(filename, userentry);
+}
+#pragma code-name (pop)
 
 /*
  * Load and run an external app
@@ -204,7 +234,6 @@ char cgetc_update_status() {
     ++ctr;
     if (ctr == 20000) {
       status_bar();
-      goto_prompt_row();
       ctr = 0;
     }
   }
@@ -344,15 +373,17 @@ void readdatetime(struct datetime *dt) {
 #pragma code-name (pop)
 
 /*
- * Print a date/time value in short format for the status bar
+ * Format a date/time value in short format for the status bar
+ * dt - structure representing date/time
+ * s  - result is returned through this pointer
  */
 #pragma code-name (push, "LC")
-void printdatetime(struct datetime *dt) {
+void datetimeshort(struct datetime *dt, char *s) {
   if (dt->nodatetime)
-    fputs("????-??-?? ??:??", stdout);
+    strcpy(s, "????-??-?? ??:??");
   else {
-    printf("%04d-%02d-%02d %02d:%02d",
-           dt->year, dt->month, dt->day, dt->hour, dt->minute);
+    sprintf(s, "%04d-%02d-%02d %02d:%02d",
+            dt->year, dt->month, dt->day, dt->hour, dt->minute);
   }
 }
 #pragma code-name (pop)
@@ -378,12 +409,13 @@ void datetimelong(struct datetime *dt, char *s) {
 
 /*
  * Obtain the system date and time for the status bar
+ * s - result is returned through this pointer
  */
 #pragma code-name (push, "LC")
-void printsystemdate(void) {
+void systemdate(char *s) {
   struct datetime dt;
   readdatetime(&dt);
-  printdatetime(&dt);
+  datetimeshort(&dt, s);
 }
 #pragma code-name (pop)
 
@@ -417,6 +449,9 @@ uint8_t read_email_db(uint16_t startnum, uint8_t initialize, uint8_t switchmbox)
   uint16_t l;
   if (initialize) {
     total_new = total_msgs = total_tag = 0;
+    // Only newsgroup mailboxes have NEWS.READ, otherwise the set is empty
+    snprintf(filename, 80, news_read, cfg_emaildir, curr_mbox);
+    newsrc_load(filename, &readset);
   }
   free_headers_list();
   snprintf(filename, 80, email_db, cfg_emaildir, curr_mbox);
@@ -464,6 +499,8 @@ uint8_t read_email_db(uint16_t startnum, uint8_t initialize, uint8_t switchmbox)
       free(curr);
       break;
     }
+    if ((curr->status == 'N') && newsrc_has(&readset, curr->emailnum))
+      curr->status = 'R';
     if (count <= MSGS_PER_PAGE) {
       if (!prev)
         headers = curr;
@@ -502,79 +539,6 @@ uint8_t read_email_db(uint16_t startnum, uint8_t initialize, uint8_t switchmbox)
 }
 #pragma code-name (pop)
 
-/*
- * Base64 decode table
- */
-const int8_t b64dec[] =
-  {62,-1,-1,-1,63,52,53,54,55,56,
-   57,58,59,60,61,-1,-1,-1,-2,-1,
-   -1,-1, 0, 1, 2, 3, 4, 5, 6, 7,
-    8, 9,10,11,12,13,14,15,16,17,
-   18,19,20,21,22,23,24,25,-1,-1,
-   -1,-1,-1,-1,26,27,28,29,30,31,
-   32,33,34,35,36,37,38,39,40,41,
-   42,43,44,45,46,47,48,49,50,51};
-
-/*
- * Decode Base64 format in place
- * Each line of base64 has up to 76 chars, which decodes to up to 57 bytes
- * p - Pointer to buffer to decode. Results written in place.
- * Returns number of bytes decoded
- */
-uint16_t decode_base64(char *p) {
-  uint16_t i = 0, j = 0;
-  const int8_t *b = b64dec - 43;
-  while (p[i] && (p[i] != '\r') && (p[i] != '?')) {
-    p[j++] = b[p[i]] << 2 | b[p[i + 1]] >> 4;
-    if (p[i + 2] != '=')
-      p[j++] = b[p[i + 1]] << 4 | b[p[i + 2]] >> 2;
-    if (p[i + 3] != '=')
-      p[j++] = b[p[i + 2]] << 6 | b[p[i + 3]];
-    i += 4;
-  }
-  p[j] = '\0';
-  return j;
-}
-
-/*
- * Convert hex char to value
- */
-#pragma code-name (push, "LC")
-uint8_t hexdigit(char c) {
-  if ((c >= '0') && (c <= '9'))
-    return c - '0';
-  else
-    return c - 'A' + 10;
-}
-#pragma code-name (pop)
-
-/*
- * Decode buffer from quoted-printable format in place
- * p - Pointer to buffer to decode. Results written in place.
- * Returns number of bytes decoded
- */
-uint16_t decode_quoted_printable(uint8_t *p, uint8_t isheader) {
-  uint16_t i = 0, j = 0;
-  uint8_t c;
-  while (c = p[i]) {
-    if (c == '=') {
-      if (p[i + 1] == '\r') // Trailing '=' is a soft '\r'
-        break;
-      // Otherwise '=xx' where x is a hex digit
-      c = 16 * hexdigit(p[i + 1]) + hexdigit(p[i + 2]);
-      p[j++] = c;
-      i += 3;
-    } else if ((c == '?') && isheader)
-      break;
-    else {
-      p[j++] = c;
-      ++i;
-    }
-  }
-  p[j] = '\0';
-  return j;
-}
-
 /*
  * Print a header field from char postion start to end,
  * padding with spaces as needed
@@ -589,57 +553,63 @@ void printfield(char *s, uint8_t start, uint8_t end) {
 #pragma code-name (pop)
 
 /*
- * Decode Subject or From header which may be encoded
- * Quoted-Printable or Base64
- * p - pointer to subject header content
- * Decoded (and sanitized) text is returned in linebuf[]
+ * Copy a header field into a screen row buffer, padding with spaces
+ * d - destination in row buffer
+ * s - field to copy
+ * n - width of field
  */
-void decode_qp_header(char *p) {
-  uint8_t i = 0, j = 0;
-  if (strncasecmp(p, "=?utf-8?", 8) == 0) {
-    strcpy(linebuf, p + 10); // Skip '=?UTF-8?x?'
-    if (p[8] == 'B')
-      decode_base64(linebuf);
-    else
-      decode_quoted_printable(linebuf, 1);
-    while (linebuf[i]) {
-      if ((linebuf[i] <= 127) && (linebuf[i] >= 32))
-        linebuf[j++] = linebuf[i];
-      else if (linebuf[i] > 191)     // 11xxxxxx
-        linebuf[j++] = '#';
-      ++i;
-    }
-    linebuf[j] = '\0';
-  } else
-    strcpy(linebuf, p);
+#pragma code-name (push, "LC")
+void fillfield(char *d, char *s, uint8_t n) {
+  while (n--)
+    *d++ = (*s ? *s++ : ' ');
 }
+#pragma code-name (pop)
 
 /*
- * Print one line summary of email headers for one message
+ * Return display-ready text for a From or Subject header field
+ * POP65 and NNTP65 decode RFC 2047 encoded-words as messages arrive, so
+ * this is normally just the field itself. Records written by older
+ * versions are decoded the first time they are used and the result is
+ * kept in the record, so redrawing does not decode them again.
+ * p - pointer to header field (80 bytes)
  */
-void print_one_email_summary(struct emailhdrs *h, uint8_t inverse) {
-  putchar(inverse ? INVERSE : NORMAL);
-  putchar(h->tag == 'T' ? 'T' : ' ');
+char *hdr_text(char *p) {
+  if (strstr(p, "=?")) {
+    linebuf[0] = '\0';
+    decode_header(linebuf, p, 80);
+    strncpy(p, linebuf, 80);
+  }
+  return p;
+}
+
+/*
+ * Print one line summary of email headers for one message
+ * The whole row is assembled in rowtext[] and written to video memory
+ * in one go.
+ * h - headers of message
+ * row - screen row
+ * inverse - 1 for the highlighted message
+ */
+void print_one_email_summary(struct emailhdrs *h, uint8_t row, uint8_t inverse) {
+  rowtext[0] = (h->tag == 'T' ? 'T' : ' ');
   switch(h->status) {
   case 'N':
-    putchar('*'); // New
-    break;
-  case 'R':
-    putchar(' '); // Read
+    rowtext[1] = '*'; // New
     break;
   case 'D':
-    putchar('D'); // Deleted
+    rowtext[1] = 'D'; // Deleted
     break;
+  default:
+    rowtext[1] = ' '; // Read
   }
-  putchar('|');
-  printfield(h->date, 0, 16);
-  putchar('|');
-  decode_qp_header(h->from);
-  printfield(linebuf, 0, 20);
-  putchar('|');
-  decode_qp_header(h->subject);
-  printfield(linebuf, 0, 39);
-  putchar(NORMAL);
+  rowtext[2] = '|';
+  fillfield(rowtext + 3, h->date, 16);
+  rowtext[19] = '|';
+  fillfield(rowtext + 20, hdr_text(h->from), 20);
+  rowtext[40] = '|';
+  fillfield(rowtext + 41, hdr_text(h->subject), 39);
+  rowtext[80] = '\0';
+  putrow80(row, inverse, rowtext);
 }
 
 /*
@@ -662,7 +632,6 @@ struct emailhdrs *get_headers(uint16_t n) {
  */
 #define MAXSTATLEN 62
 void status_bar(void) {
-  uint8_t i;
   if (num_msgs == 0) {
     sprintf(linebuf, "%s [%s] No messages ", PROGNAME, curr_mbox);
     //envelope();
@@ -674,16 +643,9 @@ void status_bar(void) {
     linebuf[MAXSTATLEN] = '\0';
     linebuf[MAXSTATLEN-3] = linebuf[MAXSTATLEN-2] = linebuf[MAXSTATLEN-1] = '.';
   }
-  putchar(HOME);
-  putchar(INVERSE);
-  fputs(linebuf, stdout);
-  for (i = 0; i < MAXSTATLEN+2 - strlen(linebuf); ++i)
-    fputc(' ', stdout);
-  printsystemdate();
-  putchar(HOME);
-  putchar(NORMAL);
-  putchar(CURDOWN);
-  printf("\n");
+  fillfield(rowtext, linebuf, MAXSTATLEN+2);
+  systemdate(rowtext + MAXSTATLEN+2);
+  putrow80(0, 1, rowtext);
 }
 
 /*
@@ -695,27 +657,20 @@ void email_summary(void) {
   clrscr2();
   status_bar();
   while (h) {
-    print_one_email_summary(h, (i == selection));
+    print_one_email_summary(h, i + 1, (i == selection));
     ++i;
     h = h->next;
   }
-  putchar(HOME);
-  for (i = 0; i < PROMPT_ROW - 2; ++i) 
-    putchar(CURDOWN);
-  printf("%cOA-? Help                                                                       %c", INVERSE, NORMAL);
+  putrow80(PROMPT_ROW - 2, 1, "OA-? Help");
+  goto_prompt_row();
 }
 
 /*
  * Show email summary for nth email message in list of headers
  */
 void email_summary_for(uint16_t n) {
-  struct emailhdrs *h = headers;
-  uint16_t j;
-  h = get_headers(n);
-  putchar(HOME);
-  for (j = 0; j < n + 1; ++j) 
-    putchar(CURDOWN);
-  print_one_email_summary(h, (n == selection));
+  struct emailhdrs *h = get_headers(n);
+  print_one_email_summary(h, n + 1, (n == selection));
 }
 
 /*
@@ -768,15 +723,83 @@ done:
   return i;
 }
 
+/*
+ * Write out any text collected in wrapblk[] by wrap_putc()
+ * f - File handle to write to
+ */
+void wrap_file_flush(FILE *f) {
+  spinner();
+  fwrite(wrapblk, 1, wrapused, f);
+  wrapused = 0;
+}
+
+/*
+ * Output one character for word_wrap_line()
+ * Text for the screen is collected a row at a time in rowtext[] and
+ * written straight to video memory when the row is complete, rather
+ * than going through the firmware one character at a time.
+ * Text for a file is collected in wrapblk[], if it has been allocated,
+ * and written in blocks of WRAPBLK bytes.
+ * f - File handle to use for output, or stdout for the screen
+ * c - Character to output
+ */
+void wrap_putc(FILE *f, char c) {
+  if (f != stdout) {
+    if (!wrapblk) {
+      fputc(c, f);
+      return;
+    }
+    wrapblk[wrapused++] = c;
+    if (wrapused == WRAPBLK)
+      wrap_file_flush(f);
+    return;
+  }
+  if (c != '\r')
+    rowtext[scr_col++] = c;
+  if ((c == '\r') || (scr_col == 80)) {
+    rowtext[scr_col] = '\0';
+    putrow80(scr_row, 0, rowtext);
+    scr_col = 0;
+    gotoxy(0, ++scr_row);
+  }
+}
+
+/*
+ * Pick up the screen position before word wrapping to the screen,
+ * in case anything else has been printed since last time.
+ * Partial rows written by others are not merged, output starts on
+ * the following row instead.
+ */
+void wrap_screen_sync(void) {
+  if ((*(uint8_t*)CURSORROW == scr_row) && (wherex() == scr_col))
+    return;
+  scr_row = *(uint8_t*)CURSORROW;
+  scr_col = 0;
+  if (wherex() != 0)
+    gotoxy(0, ++scr_row);
+}
+
+/*
+ * Show any partial row collected by wrap_putc() and leave the cursor
+ * after it, so that other output continues in the right place.
+ */
+void wrap_screen_flush(void) {
+  if (scr_col == 0)
+    return;
+  rowtext[scr_col] = '\0';
+  putrow80(scr_row, 0, rowtext);
+  gotoxy(scr_col, scr_row);
+}
+
 /*
  * Print line up to first '\r' or '\0'
  */
 void putline(FILE *f, char *s) {
   while ((*s != NULL) && (*s != '\r')) {
     if ((*s <= 127) && (*s >= 32))
-      fputc(*s, f);
+      wrap_putc(f, *s);
     else if (*s > 191)   // 11xxxxxx
-      fputc('#', f);
+      wrap_putc(f, '#');
     ++s;
   }
 }
@@ -813,9 +836,9 @@ uint8_t word_wrap_line(FILE *fp, char **s, uint8_t cols, char mode) {
       if (ret) {
         col = 0;
         if (col + l != cols) {
-          fputc('\r', fp);
+          wrap_putc(fp, '\r');
           if ((mode == 'R') || (mode == 'N')) {
-            fputc('>', fp);
+            wrap_putc(fp, '>');
             ++col;
           }
         }
@@ -829,16 +852,16 @@ uint8_t word_wrap_line(FILE *fp, char **s, uint8_t cols, char mode) {
       if (col == 0) {              // Doesn't fit on full line
         for (i = 0; i <= cols; ++i) { // Truncate @cols chars
           if ((ss[i] <= 127) && (ss[i] >= 32))
-            fputc(ss[i], fp);
+            wrap_putc(fp, ss[i]);
           else if (ss[i] > 191)    // 11xxxxxx
-            fputc('#', fp);
+            wrap_putc(fp, '#');
         }
         *s = ss + l + 1;
       } else {                     // There is stuff on this line already
         col = 0;
-        fputc('\r', fp);           // Try a blank line
+        wrap_putc(fp, '\r');       // Try a blank line
         if ((mode == 'R') || (mode == 'N')) {
-          fputc('>', fp);
+          wrap_putc(fp, '>');
           ++col;
         }
       }
@@ -854,10 +877,10 @@ uint8_t word_wrap_line(FILE *fp, char **s, uint8_t cols, char mode) {
   }
   ss[i] = '\0';                    // Space was found, split line
   putline(fp, ss);
-  fputc('\r', fp);
+  wrap_putc(fp, '\r');
   col = 0;
   if ((mode == 'R') || (mode == 'N')) {
-    fputc('>', fp);
+    wrap_putc(fp, '>');
     ++col;
   }
   *s = ss + i + 1;
@@ -1085,9 +1108,23 @@ uint8_t is_mime_boundary(char *p) {
  return 0;
 }
 
+/*
+ * Close an attachment being saved by email_pager()
+ * f - attachment file
+ * applefile - 1 if AppleSingle is being unwrapped into it
+ */
+void close_attachment(FILE *f, uint8_t applefile) {
+  if (applefile)
+    as_end(&asf);
+  else
+    fclose(f);
+}
+
 /*
  * Display email with simple pager functionality
  * Includes support for decoding MIME headers
+ * AppleSingle attachments are unwrapped as they are saved, so they get
+ * back their ProDOS file type and aux type.
  */
 void email_pager(struct emailhdrs *h) {
   static struct emailhdrs hh;
@@ -1097,7 +1134,7 @@ void email_pager(struct emailhdrs *h) {
   const int8_t *b = b64dec - 43;
   FILE *attachfp;
   uint16_t linecount, chars;
-  uint8_t mime_enc, mime_binary, mime_hasfile, eof,
+  uint8_t mime_enc, mime_binary, mime_hasfile, mime_applefile, eof,
           screennum, maxscreennum, attnum;
   uint8_t c, *readp, *writep;
 
@@ -1111,6 +1148,9 @@ void email_pager(struct emailhdrs *h) {
   snprintf(filename, 80, email_file, cfg_emaildir, curr_mbox, hh.emailnum);
   fp = fopen(filename, "rb");
   if (!fp) {
+    // Header-only newsgroups keep the Message-ID in place of Organization
+    if (!strncmp(hh.to, "News:", 5) && (hh.cc[0] == '<'))
+      fetch_article(hh.emailnum);
     if (sbackfp)
       fclose(sbackfp);
     error(ERR_NONFATAL, cant_open, filename);
@@ -1128,6 +1168,7 @@ restart:
   attachfp = NULL;
   mime_binary = 0;
   mime_hasfile = 0;
+  mime_applefile = 0;
   attnum = 0;
   if (sbackfp)
     fclose(sbackfp);
@@ -1144,8 +1185,7 @@ restart:
   fputs("Date:    ", stdout);
   printfield(hh.date, 0, 39);
   fputs("\nFrom:    ", stdout);
-  decode_qp_header(hh.from);
-  printfield(linebuf, 0, 70);
+  printfield(hdr_text(hh.from), 0, 70);
   if (strncmp(hh.to, "News:", 5) == 0) {
     fputs("\nNewsgrp: ", stdout);
     printfield(&(hh.to[5]), 0, 70);
@@ -1162,8 +1202,7 @@ restart:
     }
   }
   fputs("\nSubject: ", stdout);
-  decode_qp_header(hh.subject);
-  printfield(linebuf, 0, 70);
+  printfield(hdr_text(hh.subject), 0, 70);
   fputs("\n\n", stdout);
   get_line(fp, 1, linebuf, LINEBUFSZ, &pos); // Reset buffer
   while (1) {
@@ -1178,7 +1217,7 @@ restart:
     ++linecount;
     if ((mime >= 1) && is_mime_boundary(writep)) {
       if (attachfp)
-        fclose(attachfp);
+        close_attachment(attachfp, mime_applefile);
       if ((mime == 4) && mime_hasfile) {
         putchar(BACKSPACE); // Erase spinner
         puts("[OK]");
@@ -1188,6 +1227,7 @@ restart:
       mime_enc = ENC_7BIT;
       mime_binary = 0;
       mime_hasfile = 0;
+      mime_applefile = 0;
       readp = writep = NULL;
     } else if ((mime < 4) && (mime >= 2)) {
       if (!strncasecmp(writep, ct, 14)) {
@@ -1197,6 +1237,7 @@ restart:
           printf("\n<Not showing HTML>\n");
           mime = 1;
         } else {
+          mime_applefile = !strncasecmp(writep + 14, AS_MIMETYPE, 21);
           mime = 2 + mime_get_boundary(); // 3 if boundary, 2 otherwise
           mime_binary = 1;
         }
@@ -1225,6 +1266,8 @@ prompt_dl:
             printf("\n*** Can't open %s\n", filename);
             goto prompt_dl;
           }
+          if (mime_applefile)
+            as_begin(&asf, attachfp, filename);
         } else
           attachfp = NULL;
       } else if ((mime == 3) && (!strncmp(writep, "\r", 1))) {
@@ -1243,7 +1286,7 @@ prompt_dl:
     } else if (mime == 4) {
       switch (mime_enc) {
       case ENC_QP:
-        chars = decode_quoted_printable(writep, 0);
+        chars = decode_quoted_printable(writep);
         break;
        case ENC_B64:
         chars = decode_base64(writep);
@@ -1257,11 +1300,13 @@ prompt_dl:
     }
     if (readp) {
       if ((mime == 0) || ((mime == 4) && !mime_hasfile)) {
+        wrap_screen_sync();
         do {
           c = word_wrap_line(stdout, &readp, 80, 0);
           if (*cursorrow == 22)
             break; 
         } while (c == 1);
+        wrap_screen_flush();
         if (readp) {
           chars = strlen(readp);
           memmove(linebuf, readp, strlen(readp));
@@ -1271,8 +1316,12 @@ prompt_dl:
           writep = NULL;
       }
       if ((mime == 4) && mime_hasfile) {
-        if (attachfp)
-          fwrite(readp, 1, chars, attachfp);
+        if (attachfp) {
+          if (mime_applefile)
+            as_write(&asf, readp, chars);
+          else
+            fwrite(readp, 1, chars, attachfp);
+        }
         readp = writep = NULL;
       }
       if (mime == 1) {
@@ -1358,7 +1407,7 @@ retry:
         goto restart;
       case 'q':
         if (attachfp)
-          fclose(attachfp);
+          close_attachment(attachfp, mime_applefile);
         if (sbackfp)
           fclose(sbackfp);
         fclose(fp);
@@ -1372,6 +1421,315 @@ retry:
   }
 }
 
+/*
+ * Map of the MIME parts of one message, built in a single pass over the
+ * file. Each part is recorded by file offset, so it can be decoded later
+ * by seeking straight to it, without parsing the message again.
+ */
+#define MAXPARTS 12
+enum part_type {PART_TEXT, PART_HTML, PART_APPLEFILE, PART_OTHER};
+struct mimepart {
+  uint32_t start;            // Offset of first line of part body
+  uint32_t end;              // Offset of boundary line ending the part
+  uint8_t  enc;              // enum mime_enc
+  uint8_t  type;             // enum part_type
+  char     filename[16];     // Sanitized ProDOS filename, or empty
+};
+static struct mimepart mime_parts[MAXPARTS];
+static uint8_t         mime_nparts;
+static uint16_t        mime_map_num;  // EMAIL.n described by map, 0 if none
+
+enum map_state {MAP_HDRS, MAP_BODY, MAP_SKIP};
+
+/*
+ * Is MIME part p the one to quote in a reply or forwarded message?
+ * This is the first text/plain part which is not an attachment
+ */
+#define is_quotable(p) (((p)->type == PART_TEXT) && !(p)->filename[0] && \
+                        ((p)->enc != ENC_SKIP))
+
+/*
+ * Decode one line of the body being quoted and word wrap it to f
+ * Any text left over which does not make up a whole output line is moved
+ * to the start of linebuf[], and the next line should be read in after it.
+ * f - File handle for destination file
+ * line - Text just read, following any carried over text in linebuf[]
+ * enc - MIME encoding of the part being quoted
+ * mode - 'R' if reply, 'F' if forward, 'N' if news follow-up
+ * Returns number of chars carried over
+ */
+uint16_t quote_line(FILE *f, char *line, uint8_t enc, char mode) {
+  char *readp = linebuf;
+  uint16_t l;
+  switch (enc) {
+  case ENC_QP:
+    decode_quoted_printable(line);
+    break;
+  case ENC_B64:
+    decode_base64(line);
+    break;
+  }
+  while (word_wrap_line(f, &readp, 78, mode) == 1);
+  if (!readp)
+    return 0;
+  l = strlen(readp);
+  memmove(linebuf, readp, l);
+  return l;
+}
+
+/*
+ * Finish off any text carried over by quote_line() at the end of a part
+ * f - File handle for destination file
+ * carry - number of chars carried over
+ * mode - 'R' if reply, 'F' if forward, 'N' if news follow-up
+ */
+void quote_tail(FILE *f, uint16_t carry, char mode) {
+  if (!carry)
+    return;
+  strcpy(linebuf + carry, "\r");
+  quote_line(f, linebuf + carry, ENC_7BIT, mode);
+}
+
+/*
+ * Record the filename of a MIME part, sanitized for ProDOS
+ * p - MIME part being built
+ * s - Text following 'filename=' or 'name='
+ */
+void map_filename(struct mimepart *p, char *s) {
+  char *q;
+  sanitize_filename(s);
+  q = strrchr(s, '/');
+  if (q)
+    s = q + 1;
+  if (!s[0])
+    return;
+  if (!isalpha(s[0])) {
+    p->filename[0] = 'A'; // ProDOS names must start with a letter
+    strncpy(p->filename + 1, s, 14);
+  } else
+    strncpy(p->filename, s, 15);
+  p->filename[15] = '\0';
+}
+
+/*
+ * Build the MIME part map for a message
+ * Map is cached so calling this again for the same message is free
+ * If f is not NULL, the part to quote in a reply or forwarded message is
+ * decoded and word wrapped to f as it is found. The scan stops at the end
+ * of that part, so large attachments after it are never read, and the
+ * partial map is not cached.
+ * fp - Message file, already open
+ * h - Headers of the message
+ * f - File handle for quoted text, or NULL
+ * mode - 'R' if reply, 'F' if forward, 'N' if news follow-up
+ * Returns number of parts found
+ */
+uint8_t build_mime_map(FILE *fp, struct emailhdrs *h, FILE *f, char mode) {
+  uint32_t pos, linestart;
+  uint16_t l, carry = 0;
+  struct mimepart *p = mime_parts;
+  uint8_t state = MAP_HDRS, multi = 0, need_bdy = 0, quoting = 0;
+  char *q, *line;
+  if (mime_map_num == h->emailnum)
+    return mime_nparts;
+  mime_map_num = 0;
+  mime_nparts = 0;
+  mime_idx = 0;
+  p->enc = ENC_7BIT;
+  p->type = PART_TEXT;
+  p->filename[0] = '\0';
+  fseek(fp, 0, SEEK_SET);
+  get_line(fp, 1, linebuf, LINEBUFSZ, &pos); // Reset buffer
+  while (1) {
+    linestart = pos;
+    line = linebuf + carry;
+    if ((l = get_line(fp, 0, line, LINEBUFSZ - carry, &pos)) == 0)
+      break;
+    if (need_bdy) {
+      // Boundary may be on a continuation line after Content-Type
+      need_bdy = 0;
+      if ((linebuf[0] == ' ') || (linebuf[0] == '\t')) {
+        need_bdy = !mime_get_boundary();
+        continue;
+      }
+    }
+    if (state == MAP_HDRS) {
+      if (linebuf[0] == '\r') {
+        state = (multi ? MAP_SKIP : MAP_BODY);
+        p->start = pos;
+        quoting = (f && (state == MAP_BODY) && is_quotable(p));
+        continue;
+      }
+      if (!strncasecmp(linebuf, ct, 14)) {
+        if (!strncasecmp(linebuf + 14, "multipart", 9)) {
+          multi = 1;
+          need_bdy = !mime_get_boundary();
+        } else if (!strncasecmp(linebuf + 14, "text/plain", 10))
+          p->type = PART_TEXT;
+        else if (!strncasecmp(linebuf + 14, "text/html", 9))
+          p->type = PART_HTML;
+        else if (!strncasecmp(linebuf + 14, AS_MIMETYPE, 21))
+          p->type = PART_APPLEFILE;
+        else
+          p->type = PART_OTHER;
+      } else if (!strncasecmp(linebuf, cte, 27))
+        p->enc = mime_encoding(linebuf);
+      if (strncasecmp(linebuf, "Content-", 8) &&
+          (linebuf[0] != ' ') && (linebuf[0] != '\t'))
+        continue; // Only look for filenames in MIME headers
+      if (q = strstr(linebuf, "filename="))
+        map_filename(p, q + 9);
+      else if (!p->filename[0] && (q = strstr(linebuf, "name=")))
+        map_filename(p, q + 5);
+    } else if (mime_idx && is_mime_boundary(line)) {
+      if (state == MAP_BODY) {
+        p->end = linestart;
+        ++p;
+        ++mime_nparts;
+        if (quoting) {
+          quote_tail(f, carry, mode);
+          return mime_nparts;
+        }
+        if (mime_nparts == MAXPARTS)
+          goto done;
+      }
+      multi = 0;
+      p->enc = ENC_7BIT;
+      p->type = PART_TEXT;
+      p->filename[0] = '\0';
+      // "--boundary--" closes a multipart, what follows is epilogue
+      if ((l > 2) && (line[l - 2] == '-') && (line[l - 3] == '-'))
+        state = MAP_SKIP;
+      else
+        state = MAP_HDRS;
+    } else if (quoting)
+      carry = quote_line(f, line, p->enc, mode);
+  }
+  if (state == MAP_BODY) {
+    p->end = pos;
+    ++mime_nparts;
+  }
+  quote_tail(f, carry, mode);
+done:
+  mime_map_num = h->emailnum;
+  return mime_nparts;
+}
+
+/*
+ * Write a block of a decoded MIME part to a file
+ * AppleSingle parts are unwrapped, using asf.
+ * Returns 0 if okay, 1 on write error
+ */
+uint8_t write_part(struct mimepart *p, char *blk, uint16_t n, FILE *f) {
+  if (p->type == PART_APPLEFILE)
+    return as_write(&asf, blk, n);
+  return (fwrite(blk, 1, n, f) != n);
+}
+
+/*
+ * Decode one MIME part to a file
+ * Decoded data is accumulated in blk[] and written out in large blocks
+ * fp - Message file, already open
+ * p - MIME part to decode
+ * f - Destination file, already open
+ * blk - Output buffer of EXTRACTBLK bytes
+ * Returns 0 if okay, 1 on write error
+ */
+#define EXTRACTBLK 4096
+uint8_t decode_part(FILE *fp, struct mimepart *p, FILE *f, char *blk) {
+  uint32_t pos;
+  uint16_t chars, used = 0;
+  fseek(fp, p->start, SEEK_SET);
+  get_line(fp, 1, linebuf, LINEBUFSZ, &pos); // Reset buffer
+  pos = p->start;
+  while (pos < p->end) {
+    if ((chars = get_line(fp, 0, linebuf, LINEBUFSZ, &pos)) == 0)
+      break;
+    switch (p->enc) {
+    case ENC_QP:
+      chars = decode_quoted_printable(linebuf);
+      break;
+    case ENC_B64:
+      chars = decode_base64(linebuf);
+      break;
+    }
+    if (used + chars > EXTRACTBLK) {
+      if (write_part(p, blk, used, f))
+        return 1;
+      used = 0;
+    }
+    memcpy(blk + used, linebuf, chars);
+    used += chars;
+  }
+  return write_part(p, blk, used, f);
+}
+
+/*
+ * Save all attachments of a message to ATTACHMENTS without prompting.
+ * If a file of the same name exists, the last character of the name is
+ * replaced with a digit to make it unique.
+ * h - Headers of the message
+ * blk - Output buffer of EXTRACTBLK bytes
+ * Returns number of attachments saved
+ */
+uint8_t extract_attachments(struct emailhdrs *h, char *blk) {
+  struct mimepart *p;
+  uint8_t i, saved = 0;
+  uint16_t l;
+  char c;
+  FILE *f;
+  snprintf(filename, 80, email_file, cfg_emaildir, curr_mbox, h->emailnum);
+  fp = fopen(filename, "rb");
+  if (!fp) {
+    error(ERR_NONFATAL, cant_open, filename);
+    return 0;
+  }
+  build_mime_map(fp, h, NULL, 0);
+  for (i = 0; i < mime_nparts; ++i) {
+    p = &mime_parts[i];
+    if (!p->filename[0] || (p->enc == ENC_SKIP))
+      continue;
+    snprintf(filename, 80, "%s/ATTACHMENTS/%s", cfg_emaildir, p->filename);
+    l = strlen(filename);
+    c = '1';
+    while ((c <= '9') && (f = fopen(filename, "rb"))) {
+      fclose(f);
+      filename[l - 1] = c++;
+    }
+    _filetype = PRODOS_T_BIN;
+    _auxtype = 0;
+    f = fopen(filename, "wb");
+    if (!f) {
+      error(ERR_NONFATAL, cant_open, filename);
+      continue;
+    }
+    if (p->type == PART_APPLEFILE)
+      as_begin(&asf, f, filename);
+    if (decode_part(fp, p, f, blk))
+      error(ERR_NONFATAL, cant_write, filename);
+    else
+      ++saved;
+    if (p->type == PART_APPLEFILE)
+      as_end(&asf);
+    else
+      fclose(f);
+  }
+  fclose(fp);
+  return saved;
+}
+
+/*
+ * Mark a news article read
+ * This is recorded in NEWS.READ rather than EMAIL.DB, so only a short
+ * list of ranges is written, however many articles the newsgroup has.
+ */
+void mark_news_read(struct emailhdrs *h) {
+  newsrc_add(&readset, h->emailnum, h->emailnum);
+  snprintf(filename, 80, news_read, cfg_emaildir, curr_mbox);
+  if (newsrc_save(filename, &readset))
+    error(ERR_NONFATAL, cant_write, filename);
+}
+
 /*
  * Write updated email headers to EMAIL.DB
  */
@@ -1437,6 +1795,7 @@ void switch_mailbox(char *mbox) {
   }
   strcpy(prev_mbox, curr_mbox);
   strcpy(curr_mbox, mbox);
+  mime_map_num = 0; // EMAIL.n numbers are only unique within a mailbox
   first_msg = 1;
   i = read_email_db(first_msg, 1, 1); // Errors non-fatal
   if (i) {
@@ -1648,26 +2007,29 @@ esc_pressed:
  * Adds 'Re: ' to subject line unless it is already there
  */
 void prefix_subject(FILE *f, char *subject, char *prefix) {
-  decode_qp_header(subject);
+  hdr_text(subject);
   fprintf(f, "Subject: %s%s\r",
-          (strncmp(subject, prefix, strlen(prefix)) ? prefix : ""), linebuf);
+          (strncmp(subject, prefix, strlen(prefix)) ? prefix : ""), subject);
 }
 
 /*
  * Write email headers for replies and forwarded messages
+ * For mode 'A' this also writes the MIME wrapper up to the start of the
+ * message/rfc822 part, which is the original message copied verbatim.
  * fp1  - File handle of the mail message being replied/forwarded
  * fp2  - File handle of the destination mail message
  * h    - headers of the message being replied/forwarded
- * mode - 'R' for reply, 'F' for forward
- * fwd_to - Recipient (used for mode=='F' only)
+ * mode - 'R' for reply, 'F' for forward, 'A' for forward as attachment
+ * fwd_to - Recipient (used for mode=='F' or 'A' only)
+ * num  - Number of the destination message, used for the MIME boundary
  * Returns 0 if okay, 1 on error, 255 if ESC pressed
  */
 uint8_t write_email_headers(FILE *fp1, FILE *fp2, struct emailhdrs *h,
-                            char mode, char *fwd_to) {
+                            char mode, char *fwd_to, uint16_t num) {
   struct datetime dt;
   fprintf(fp2, "From: %s\r", cfg_emailaddr);
   truncate_header(h->subject, buf, 80);
-  prefix_subject(fp2, buf, (mode == 'F' ? "Fwd: " : "Re: "));
+  prefix_subject(fp2, buf, (mode == 'R' ? "Re: " : "Fwd: "));
   readdatetime(&dt);
   datetimelong(&dt, buf);
   fprintf(fp2, "Date: %s\r", buf);
@@ -1682,22 +2044,34 @@ uint8_t write_email_headers(FILE *fp1, FILE *fp2, struct emailhdrs *h,
     return 255; // ESC pressed
   if (strlen(userentry) > 0)
     fprintf(fp2, "cc: %s\r", userentry);
+  if (mode == 'A') {
+    fputs("MIME-Version: 1.0\r", fp2);
+    fprintf(fp2, "Content-Type: multipart/mixed; boundary=a2fwd%05u\r", num);
+  }
   fprintf(fp2, a2_forever, "X-Mailer", PROGNAME);
+  if (mode == 'A') {
+    fputs("This is a multi-part message in MIME format.\r", fp2);
+    fprintf(fp2, fwd_delim, num, "");
+    fputs("Content-Type: text/plain; charset=US-ASCII\r", fp2);
+    fputs("Content-Transfer-Encoding: 7bit\r\r\r", fp2);
+    fprintf(fp2, fwd_delim, num, "");
+    fputs("Content-Type: message/rfc822\r", fp2);
+    fputs("Content-Disposition: attachment; filename=FORWARDED.MSG\r\r", fp2);
+    fseek(fp1, 0, SEEK_SET); // Whole message, headers and all
+    return 0;
+  }
   if (mode == 'R') {
     truncate_header(h->date, buf, 40);
     fprintf(fp2, "On %s, ", buf);
-    decode_qp_header(h->from);
-    truncate_header(linebuf, buf, 80);
+    truncate_header(hdr_text(h->from), buf, 80);
     fprintf(fp2, "%s wrote:\r\r", buf);
   } else {
     fprintf(fp2, "-------- Forwarded Message --------\r");
-    decode_qp_header(h->subject);
-    truncate_header(linebuf, buf, 80);
+    truncate_header(hdr_text(h->subject), buf, 80);
     fprintf(fp2, "Subject: %s\r", buf);
     truncate_header(h->date, buf, 40);
     fprintf(fp2, "Date: %s\r", buf);
-    decode_qp_header(h->from);
-    truncate_header(linebuf, buf, 80);
+    truncate_header(hdr_text(h->from), buf, 80);
     fprintf(fp2, "From: %s\r", buf);
     truncate_header(h->to, buf, 80);
     fprintf(fp2, "To: %s\r\r", buf);
@@ -1757,7 +2131,7 @@ uint8_t write_news_headers(FILE *fp1, FILE *fp2, struct emailhdrs *h, uint16_t n
     }
   }
   fprintf(fp2, a2_forever, "User-Agent", PROGNAME);
-  truncate_header(h->from, buf, 80);
+  truncate_header(hdr_text(h->from), buf, 80);
   fprintf(fp2, "%s wrote:\r\r", buf);
   fseek(fp1, h->skipbytes, SEEK_SET); // Skip headers when copying
   return 0;
@@ -1790,124 +2164,45 @@ char prompt_okay(char *msg) {
  * Obtain the body of an email to include in a reply or forwarded message
  * For a plain text email, the body is everything after the headers
  * For a MIME multipart email, we take the first Text/Plain section
+ * If the MIME map for the message is cached, we seek straight to that
+ * section, otherwise it is quoted while the map is built. Either way the
+ * message is read once and the output is written in blocks.
  * Email file to read is expected to be already open using fp
+ * h - headers of the message
  * f - File handle for destination file (also already open)
  * mode - 'R' if reply, 'F' if forward, 'N' if news follow-up
  */
 void get_email_body(struct emailhdrs *h, FILE *f, char mode) {
-  uint16_t chars;
-  uint8_t c, *readp, *writep;
-  uint32_t pos = 0;
-  const int8_t *b = b64dec - 43;
-  uint8_t  mime = 0, mime_enc = ENC_7BIT, mime_binary, mime_hasfile;
-  fseek(fp, pos, SEEK_SET);
-  get_line(fp, 1, linebuf, LINEBUFSZ, &pos); // Reset buffer
-  mime_idx = 0;
-  do {
-    spinner();
-    get_line(fp, 0, linebuf, LINEBUFSZ, &pos);
-    if (!strncasecmp(linebuf, mime_ver, 17))
-      mime = 1;
-    if (!strncasecmp(linebuf, ct, 14)) {
-      mime = 3 + mime_get_boundary(); // 4 if boundary, 3 otherwise
-      continue;
-    }
-    if (!strncasecmp(linebuf, cte, 27)) {
-      mime = 4;
-      mime_enc = mime_encoding(linebuf);
-      if (mime_enc == ENC_SKIP) {
-        error(ERR_NONFATAL, unsupp_enc, linebuf + 27);
-        return;
+  struct mimepart *p;
+  uint32_t pos;
+  uint16_t carry = 0;
+  uint8_t i;
+  wrapblk = malloc(WRAPBLK); // If this fails wrap_putc() writes directly
+  wrapused = 0;
+  if (mime_map_num != h->emailnum)
+    build_mime_map(fp, h, f, mode);
+  else {
+    for (i = 0; i < mime_nparts; ++i) {
+      p = &mime_parts[i];
+      if (!is_quotable(p))
+        continue;
+      fseek(fp, p->start, SEEK_SET);
+      get_line(fp, 1, linebuf, LINEBUFSZ, &pos); // Reset buffer
+      pos = p->start;
+      while (pos < p->end) {
+        if (get_line(fp, 0, linebuf + carry, LINEBUFSZ - carry, &pos) == 0)
+          break;
+        carry = quote_line(f, linebuf + carry, p->enc, mode);
       }
-      continue;
-    }
-    if (mime == 3) {       // We have Content-Type but no boundary yet
-      mime_get_boundary();
-      mime = 4;
-    }
-  } while (linebuf[0] != '\r');
-  pos = h->skipbytes;
-  fseek(fp, pos, SEEK_SET);
-  readp = linebuf;
-  writep = linebuf;
-  mime_binary = 0;
-  mime_hasfile = 0;
-  get_line(fp, 1, linebuf, LINEBUFSZ, &pos); // Reset buffer
-  while (1) {
-    spinner();
-    if (!readp)
-      readp = linebuf;
-    if (!writep)
-      writep = linebuf;
-    if (get_line(fp, 0, writep, (LINEBUFSZ - (writep - linebuf)), &pos) == 0)
+      quote_tail(f, carry, mode);
       break;
-    if ((mime >= 1) && is_mime_boundary(writep)) {
-      mime = 2;
-      mime_enc = ENC_7BIT;
-      mime_binary = 0;
-      mime_hasfile = 0;
-      readp = writep = NULL;
-    } else if ((mime < 4) && (mime >= 2)) {
-      if (!strncasecmp(writep, ct, 14)) {
-        if (!strncmp(writep + 14, "text/plain", 10)) {
-          mime = 3;
-        } else if (!strncmp(writep + 14, "text/html", 9)) {
-          mime = 1;
-        } else {
-          mime = 2 + mime_get_boundary(); // 3 if boundary, 2 otherwise
-          mime_binary = 1;
-        }
-      } else if (!strncasecmp(writep, cte, 27)) {
-        mime = 3;
-        mime_enc = mime_encoding(writep);
-        if (mime_enc == ENC_SKIP) {
-          printf(unsupp_enc, writep + 27);
-          mime = 1;
-        }
-      } else if (strstr(writep, "filename=")) {
-        mime_hasfile = 1;
-      } else if ((mime == 3) && (!strncmp(writep, "\r", 1))) {
-        mime = 4;
-        if (mime_binary)
-          mime_enc = ENC_SKIP; // Skip over binary MIME parts
-      } else if (mime == 2) {
-        mime = 2 + mime_get_boundary(); // 3 if boundary, 2 otherwise
-      }
-      readp = writep = NULL;
-    } else if (mime == 4) {
-      switch (mime_enc) {
-      case ENC_QP:
-        chars = decode_quoted_printable(writep, 0);
-        break;
-       case ENC_B64:
-        chars = decode_base64(writep);
-        break;
-       case ENC_SKIP:
-        readp = writep = NULL;
-        break;
-      }
-    }
-    if (readp) {
-      if ((mime == 0) || ((mime == 4) && !mime_hasfile)) {
-        do {
-          c = word_wrap_line(f, &readp, 78, mode);
-        } while (c == 1);
-        if (readp) {
-          chars = strlen(readp);
-          memmove(linebuf, readp, strlen(readp));
-          readp = linebuf;
-          writep = linebuf + chars;
-        } else
-          writep = NULL;
-      }
-      if ((mime == 4) && mime_binary) {
-        readp = writep = NULL;
-      }
-      if (mime == 1) {
-        readp = writep = NULL;
-      }
     }
   }
+  if (wrapblk) {
+    wrap_file_flush(f);
+    free(wrapblk);
+    wrapblk = NULL;
+  }
 }
 
 /*
@@ -1917,11 +2212,13 @@ void get_email_body(struct emailhdrs *h, FILE *f, char mode) {
  * mbox is the name of the destination mailbox
  * delete - if set to 1 then the message will be marked as deleted in the
  *          source mbox
- * mode - 'R' for reply, 'F' for forward, 'N' for news follow-up, otherwise ' '
+ * mode - 'R' for reply, 'F' for forward, 'A' for forward as attachment,
+ *        'N' for news follow-up, otherwise ' '
  */
 void copy_to_mailbox(struct emailhdrs *h, uint16_t idx,
                      char *mbox, uint8_t delete, char mode) {
-  uint16_t num, buflen, l, written;
+  uint16_t num, buflen, l, written, blksz;
+  unsigned char *blk;
   FILE *fp2;
 
   if (mode == 'N') {
@@ -1931,7 +2228,7 @@ void copy_to_mailbox(struct emailhdrs *h, uint16_t idx,
     }
   }
 
-  if (mode == 'F') {
+  if ((mode == 'F') || (mode == 'A')) {
     if (prompt_for_name("Fwd to", 0) == 255)
       return; // ESC pressed
     if (strlen(userentry) == 0)
@@ -1962,8 +2259,8 @@ void copy_to_mailbox(struct emailhdrs *h, uint16_t idx,
   }
 
   l = 0;
-  if ((mode == 'R') || (mode == 'F')) {
-    l = write_email_headers(fp, fp2, h, mode, userentry);
+  if ((mode == 'R') || (mode == 'F') || (mode == 'A')) {
+    l = write_email_headers(fp, fp2, h, mode, userentry, num);
     if (l == 1)
       error(ERR_NONFATAL, "Invalid email header");
   } else if (mode == 'N') {
@@ -1978,7 +2275,7 @@ void copy_to_mailbox(struct emailhdrs *h, uint16_t idx,
   }
 
   // Make sure spinner is in the right place
-  if ((mode == 'R') || (mode == 'F') || (mode == 'N'))
+  if (mode != ' ')
     goto_prompt_row();
 
   // Copy email body
@@ -1988,19 +2285,34 @@ void copy_to_mailbox(struct emailhdrs *h, uint16_t idx,
   if ((mode == 'R') || (mode == 'F') || (mode == 'N')) {
     get_email_body(h, fp2, mode);
   } else {
+    // Verbatim copy, in large blocks if there is room on the heap
+    blk = malloc(EXTRACTBLK);
+    blksz = EXTRACTBLK;
+    if (!blk) {
+      blk = buf;
+      blksz = READSZ;
+    }
     while (1) {
-      buflen = fread(buf, 1, READSZ, fp);
+      buflen = fread(blk, 1, blksz, fp);
       spinner();
       if (buflen == 0)
         break;
-      written = fwrite(buf, 1, buflen, fp2);
+      written = fwrite(blk, 1, buflen, fp2);
       if (written != buflen) {
         error(ERR_NONFATAL, "Write error during copy");
+        if (blk != buf)
+          free(blk);
         fclose(fp);
         fclose(fp2);
         return;
       }
     }
+    if (blk != buf)
+      free(blk);
+    if (mode == 'A') {
+      fputc('\r', fp2);
+      fprintf(fp2, fwd_delim, num, "--");
+    }
   }
 
   putchar(BACKSPACE);
@@ -2116,6 +2428,59 @@ err:
   return 1;
 }
 
+/*
+ * Extract attachments from the tagged messages, or from the current
+ * message if none are tagged. No screens are drawn and no prompts are
+ * shown per attachment, so many messages can be processed unattended.
+ */
+void extract_tagged(void) {
+  static struct emailhdrs hh;
+  uint16_t tagcount = 0, saved = 0;
+  FILE *dbfp;
+  char *blk;
+  if (total_tag > 0) {
+    snprintf(filename, 80, "Extract from %u tagged - ", total_tag);
+    if (!prompt_okay(filename))
+      return;
+  }
+  hh = *get_headers(selection);
+  // Release the summary headers to make room for the output buffer.
+  // The summary is rebuilt from EMAIL.DB afterwards.
+  free_headers_list();
+  blk = malloc(EXTRACTBLK);
+  if (!blk)
+    error(ERR_FATAL, cant_malloc);
+  if (total_tag == 0) {
+    goto_prompt_row();
+    putchar(CLRLINE);
+    fputs("Extracting ...", stdout);
+    saved = extract_attachments(&hh, blk);
+    goto done;
+  }
+  snprintf(filename, 80, email_db, cfg_emaildir, curr_mbox);
+  dbfp = fopen(filename, "rb");
+  if (!dbfp) {
+    error(ERR_NONFATAL, cant_open, filename);
+    goto done;
+  }
+  while (fread(&hh, 1, EMAILHDRS_SZ_ON_DISK, dbfp) == EMAILHDRS_SZ_ON_DISK) {
+    if (hh.tag != 'T')
+      continue;
+    goto_prompt_row();
+    putchar(CLRLINE);
+    printf("%u/%u: %u attachments saved", ++tagcount, total_tag, saved);
+    saved += extract_attachments(&hh, blk);
+  }
+  fclose(dbfp);
+done:
+  free(blk);
+  read_email_db(first_msg, 0, 0);
+  email_summary();
+  goto_prompt_row();
+  putchar(CLRLINE);
+  printf("%u attachments saved to %s/ATTACHMENTS", saved, cfg_emaildir);
+}
+
 /*
  * Create a blank outgoing message and put it in OUTBOX.
  * OUTBOX is not a 'proper' mailbox (no EMAIL.DB)
@@ -2279,6 +2644,9 @@ void keyboard_hdlr(void) {
         if (h)
           copy_to_mailbox(h, get_db_index(), news_outbox, 0, 'N');
         break;
+      case 'g':    // CA-G "Find and subscribe to newsgroups"
+        load_app(APP_GROUPS);
+        break;
       }
       continue;
     }
@@ -2308,7 +2676,10 @@ void keyboard_hdlr(void) {
         if (h->status == 'N')
           --total_new;
         h->status = 'R'; // Mark email read
-        write_updated_headers(h, get_db_index());
+        if (!strncmp(h->to, "News:", 5))
+          mark_news_read(h);
+        else
+          write_updated_headers(h, get_db_index());
         email_pager(h);
         read_email_db(first_msg, 0, 0); // email_pager() deletes the headers
         email_summary();
@@ -2393,6 +2764,11 @@ void keyboard_hdlr(void) {
       if (h)
         copy_to_mailbox(h, get_db_index(), outbox, 0, 'F');
       break;
+    case 'x':
+    case 'X':
+      if (h)
+        extract_tagged();
+      break;
     // Everything above here needs a selected message (h != NULL)
     // Everything below here does NOT need a selected message
     case 'n':
@@ -2425,6 +2801,11 @@ void keyboard_hdlr(void) {
     case 0x80 + 'D':
       load_app(APP_DATE);
       break;
+    case 0x80 + 'f': // OA-F "Forward message as attachment"
+    case 0x80 + 'F':
+      if (h)
+        copy_to_mailbox(h, get_db_index(), outbox, 0, 'A');
+      break;
     case 0x80 + 'e': // OA-E "Open message in editor"
     case 0x80 + 'E':
       if (h) {
@@ -2440,6 +2821,10 @@ void keyboard_hdlr(void) {
     case 0x80 + 'S':
       load_app(APP_SMTP);
       break;
+    case 0x80 + 'y': // OA-Y "Sync email and news"
+    case 0x80 + 'Y':
+      load_app(APP_SYNC);
+      break;
     case 0x80 + '?': // OA-? "Help"
     case 0x80 + '/': // OA-/ "Help"
       help(1);
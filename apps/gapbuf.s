@@ -0,0 +1,214 @@
+; Bulk access to the editor's gap buffer in aux memory
+; The aux bank and aux read / write are switched once for a whole span,
+; rather than once per byte as get_gapbuf() and set_gapbuf() do.
+; Must be in LC, because main memory code is not visible once aux
+; memory is switched in for reading.
+
+.export _read_gapbuf_span, _write_gapbuf_span, _load_gapbuf
+.import popax, _auxbank, _gapbegin, _loadcol, _loadcr, _loadlimit
+.importzp ptr1, ptr2, ptr3, ptr4, tmp1, tmp2
+
+GAPBUFADDR = $0880		; Aux mem address of gapbuf[], as in edit.c
+
+RDMAINRAM  = $c002		; Read main memory
+RDCARDRAM  = $c003		; Read aux memory
+WRMAINRAM  = $c004		; Write main memory
+WRCARDRAM  = $c005		; Write aux memory
+RAMWORKS   = $c073		; RamWorks style bank select
+
+.segment "LC"
+
+; void __fastcall__ read_gapbuf_span(char *dst, uint16_t i, uint16_t n)
+; Copies n bytes from gapbuf[i] in aux memory to dst in main memory.
+_read_gapbuf_span:
+	sta ptr3			; n
+	stx ptr3+1
+	jsr popax			; i
+	clc
+	adc #<GAPBUFADDR
+	sta ptr1
+	txa
+	adc #>GAPBUFADDR
+	sta ptr1+1
+	jsr popax			; dst
+	sta ptr2
+	stx ptr2+1
+	lda _auxbank
+	sta RAMWORKS			; Set aux bank
+	sta RDCARDRAM
+	jsr copy
+	sta RDMAINRAM
+	bra done
+
+; void __fastcall__ write_gapbuf_span(uint16_t i, char *src, uint16_t n)
+; Copies n bytes from src in main memory to gapbuf[i] in aux memory.
+_write_gapbuf_span:
+	sta ptr3			; n
+	stx ptr3+1
+	jsr popax			; src
+	sta ptr1
+	stx ptr1+1
+	jsr popax			; i
+	clc
+	adc #<GAPBUFADDR
+	sta ptr2
+	txa
+	adc #>GAPBUFADDR
+	sta ptr2+1
+	lda _auxbank
+	sta RAMWORKS			; Set aux bank
+	sta WRCARDRAM
+	jsr copy
+	sta WRMAINRAM
+done:	lda #$00
+	sta RAMWORKS			; Set aux bank back to 0
+	rts
+
+; Copy ptr3 bytes from (ptr1) to (ptr2), whole pages first
+copy:	ldy #$00
+	ldx ptr3+1
+	beq part
+page:	lda (ptr1),y
+	sta (ptr2),y
+	iny
+	bne page
+	inc ptr1+1
+	inc ptr2+1
+	dex
+	bne page
+part:	ldx ptr3
+	beq :++
+:	lda (ptr1),y
+	sta (ptr2),y
+	iny
+	dex
+	bne :-
+:	rts
+
+col	= tmp1			; Screen column, for tabs
+lastcr	= tmp2			; Non-zero if last char read was CR
+
+; uint16_t __fastcall__ load_gapbuf(char *p, uint16_t n)
+; Appends n bytes of text from p to gapbuf[] at gapbegin, and advances
+; gapbegin. CR, LF and CRLF line endings all become CR, and tabs are
+; expanded to spaces, with the same tab stops as next_tabstop().
+; Stops early after a line ending once gapbegin reaches loadlimit, so
+; the caller can move on to the next bank.
+; loadcol and loadcr carry the state from one call to the next.
+; The caller must make sure there is room for n tabs.
+; Returns number of bytes of p used.
+_load_gapbuf:
+	sta ptr3			; n, counted down
+	stx ptr3+1
+	sta count
+	stx count+1
+	jsr popax			; p
+	sta ptr1
+	stx ptr1+1
+	clc
+	lda _gapbegin
+	adc #<GAPBUFADDR
+	sta ptr2
+	lda _gapbegin+1
+	adc #>GAPBUFADDR
+	sta ptr2+1
+	clc
+	lda _loadlimit
+	adc #<GAPBUFADDR
+	sta ptr4
+	lda _loadlimit+1
+	adc #>GAPBUFADDR
+	sta ptr4+1
+	lda _loadcol
+	sta col
+	lda _loadcr
+	sta lastcr
+	lda _auxbank
+	sta RAMWORKS			; Set aux bank
+	sta WRCARDRAM			; Main memory is still read
+
+next:	lda ptr3
+	bne :+
+	lda ptr3+1
+	beq finish			; All of p used
+	dec ptr3+1
+:	dec ptr3
+	lda (ptr1)
+	inc ptr1
+	bne :+
+	inc ptr1+1
+:	cmp #$0d
+	beq cr
+	cmp #$0a
+	beq lf
+	cmp #$09
+	beq tab
+	stz lastcr
+	sta (ptr2)
+	inc ptr2
+	bne :+
+	inc ptr2+1
+:	inc col
+	bra next
+
+tab:	stz lastcr
+	lda col				; 8 - (col & 7) spaces
+	and #$07
+	eor #$07
+	tax
+	inx
+	lda #' '
+:	sta (ptr2)
+	inc ptr2
+	bne :+
+	inc ptr2+1
+:	inc col
+	dex
+	bne :--
+	bra next
+
+lf:	lda lastcr
+	stz lastcr
+	bne next			; LF of CRLF, already done
+	bra eol
+cr:	sta lastcr
+eol:	lda #$0d
+	sta (ptr2)
+	inc ptr2
+	bne :+
+	inc ptr2+1
+:	stz col
+	lda ptr2+1			; Stop if loadlimit reached
+	cmp ptr4+1
+	bcc next
+	bne finish
+	lda ptr2
+	cmp ptr4
+	bcc next
+
+finish:	sta WRMAINRAM
+	lda #$00
+	sta RAMWORKS			; Set aux bank back to 0
+	sec
+	lda ptr2
+	sbc #<GAPBUFADDR
+	sta _gapbegin
+	lda ptr2+1
+	sbc #>GAPBUFADDR
+	sta _gapbegin+1
+	lda col
+	sta _loadcol
+	lda lastcr
+	sta _loadcr
+	sec				; Return bytes used
+	lda count
+	sbc ptr3
+	pha
+	lda count+1
+	sbc ptr3+1
+	tax
+	pla
+	rts
+
+.bss
+count:	.res 2				; Bytes of p requested
@@ -0,0 +1,1078 @@
+/////////////////////////////////////////////////////////////////
+// GROUPS65
+// Find and subscribe to Usenet newsgroups
+// Keeps a sorted copy of the server's list of newsgroups (LIST ACTIVE)
+// on disk, so it can be searched without going online. The list is
+// downloaded once and then kept up to date with NEWGROUPS.
+// https://www.ietf.org/rfc/rfc3977.txt
+/////////////////////////////////////////////////////////////////
+
+#include <cc65.h>
+#include <errno.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <conio.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <apple2_filetype.h>
+
+#include "../inc/ip65.h"
+#include "w5100.h"
+
+#include "email_common.h"
+#include "netio.h"
+
+#define BACKSPACE 8
+
+// Both pragmas are obligatory to have cc65 generate code
+// suitable to access the W5100 auto-increment registers.
+#pragma optimize      (on)
+#pragma static-locals (on)
+
+#define NETBUFSZ  512          // Only short responses are read into buf[]
+#define LINEBUFSZ 1000         // According to RFC2822 Section 2.1.1 (998+CRLF)
+#define BLKSZ     512          // Size of a block of ACTIVE.DB
+#define KEYSZ     24           // Chars of the first entry of a block in ACTIVE.IDX
+#define NAMESZ    80           // Max length of an entry (group name and flag)
+// Files merged at once. cc65 has FOPEN_MAX streams including stdin, stdout
+// and stderr, and the final merge also writes ACTIVE.TMP and ACTIVE.ITMP.
+#define MERGEWAY  (FOPEN_MAX - 5)
+#define NEWMAX    100          // Groups in ACTIVE.NEW before merging it in
+#define PAGE      18           // Number of groups listed at once
+#define MAXARENA  16384        // Max memory used to sort the list
+
+// The list of newsgroups is kept in the email root directory:
+// ACTIVE.DB    Entries of the form "name flag", sorted by name, each ending
+//              in CR. Entries never span one of the 512 byte blocks of the
+//              file, and the end of each block is padded with zeros.
+// ACTIVE.IDX   The first KEYSZ chars of the first entry of each block, so
+//              the block holding a given name can be found by binary search.
+// ACTIVE.NEW   New groups not yet merged into ACTIVE.DB, not sorted
+// ACTIVE.DATE  Server time of the last update, for NEWGROUPS
+// While the list is being built, sorted runs RUN.n are kept in NEWS.SPOOL.
+
+// File with a block sized buffer, to avoid one ProDOS call per char
+struct bfile {
+  FILE     *fp;
+  uint16_t pos;                // Read or write position in buf[]
+  uint16_t end;                // End of valid data in buf[] when reading
+  char     buf[BLKSZ];
+};
+
+static unsigned char buf[NETBUFSZ+1];    // One extra byte for null terminator
+static char          linebuf[LINEBUFSZ];
+static char          entry[NAMESZ];
+static char          key[KEYSZ];
+static struct bfile  in[MERGEWAY];
+static struct bfile  out;
+static char          line[MERGEWAY][NAMESZ];
+static char          found[PAGE][NAMESZ];
+
+uint8_t  exec_email_on_exit = 0;
+char     filename[80];
+char     filename2[80];
+FILE     *fp, *idxfp;
+uint16_t nntp_port;
+uint8_t  online = 0;           // 1 once connected to the server
+char     *arena;               // Memory for sorting
+uint16_t arenasz;
+uint16_t arenaused;            // Bytes used by entries, from the bottom
+uint16_t numsort;              // Number of pointers, from the top
+uint16_t nruns;                // Number of RUN.n files created
+uint16_t nblocks;              // Number of blocks in ACTIVE.DB
+uint32_t count;                // Number of groups seen
+char     stamp[16];            // Server time, "yyyymmdd hhmmss"
+
+/*
+ * Keypress before quit
+ */
+void confirm_exit(void) {
+  if (online) {
+    w5100_disconnect();
+    online = 0;
+  }
+  printf("\n[Press Any Key]");
+  cgetc();
+  if (exec_email_on_exit) {
+    sprintf(filename, "%s/EMAIL.SYSTEM", cfg_instdir);
+    exec(filename, NULL);
+  }
+  exit(0);
+}
+
+/*
+ * Called for all non IP65 errors
+ */
+void error_exit() {
+  confirm_exit();
+}
+
+/*
+ * Called if IP65 call fails
+ */
+void ip65_error_exit(void) {
+  printf("%s\n", ip65_strerror(ip65_error));
+  confirm_exit();
+}
+
+/*
+ * Print message to the console, stripping extraneous CRLF stuff
+ * from the end.
+ */
+void print_strip_crlf(char *s) {
+  uint8_t i = 0;
+  while ((s[i] != '\0') && (s[i] != '\r') && (s[i] != '\n'))
+    putchar(s[i++]);
+  putchar('\n');
+}
+
+/*
+ * Spinner while downloading or sorting
+ */
+void spinner(uint32_t sz, uint8_t final) {
+  static char chars[] = "|/-\\";
+  static char buf[12] = "";
+  static uint8_t i = 0;
+  uint8_t j;
+  for (j = 0; j < strlen(buf); ++j)
+    putchar(BACKSPACE);
+  if (final) {
+    sprintf(buf, " [%lu]\n", sz);
+    printf("%s", buf);
+    strcpy(buf, "");
+  }
+  else {
+    sprintf(buf, "%c %lu", chars[(i++) % 4], sz);
+    printf("%s", buf);
+  }
+}
+
+#define DO_SEND   1  // For do_send param
+#define DONT_SEND 0  // For do_send param
+
+// Sends a command and receives the one line response into buf[]
+// sendbuf is the buffer to send (null terminated)
+// do_send Do the sending if true, otherwise skip
+bool w5100_tcp_send_recv(char* sendbuf, uint8_t do_send) {
+  if (do_send == DO_SEND) {
+    if (strncmp(sendbuf, "AUTHINFO PASS", 13) == 0)
+      printf(">AUTHINFO PASS ****\n");
+    else {
+      putchar('>');
+      print_strip_crlf(sendbuf);
+    }
+    if (!w5100_send_text(sendbuf))
+      return false;
+  }
+  if (!w5100_get_line(buf, NETBUFSZ))
+    return false;
+  putchar('<');
+  print_strip_crlf(buf);
+  return true;
+}
+
+/*
+ * Check expected string from server
+ */
+uint8_t expect(char *buf, char *s) {
+  if (strncmp(buf, s, strlen(s)) != 0) {
+    printf("\nExpected '%s' got '%s'\n", s, buf);
+    return 1;
+  }
+  return 0;
+}
+
+/*
+ * Read parms from NEWS.CFG
+ */
+void readconfigfile(void) {
+  char *colon;
+  fp = fopen("NEWS.CFG", "r");
+  if (!fp) {
+    puts("Can't open config file NEWS.CFG");
+    error_exit();
+  }
+  fscanf(fp, "%s", cfg_server);
+  fscanf(fp, "%s", cfg_user);
+  fscanf(fp, "%s", cfg_pass);
+  fscanf(fp, "%s", cfg_instdir);
+  fscanf(fp, "%s", cfg_emaildir);
+  fscanf(fp, "%s", cfg_emailaddr);
+  fclose(fp);
+  fp = NULL;
+
+  colon = strchr(cfg_server, ':');
+  if (!colon)
+    nntp_port = 119;
+  else {
+    nntp_port = atoi(colon + 1);
+    *colon = '\0';
+  }
+}
+
+/*
+ * Bring up the network and log in to the news server
+ * Only done the first time the server is needed.
+ */
+void go_online(void) {
+  uint8_t eth_init = ETH_INIT_DEFAULT;
+  static char sendbuf[80];
+
+  if (online)
+    return;
+
+  {
+    int file;
+    printf("\nSetting slot                 - ");
+    file = open("ethernet.slot", O_RDONLY);
+    if (file != -1) {
+      read(file, &eth_init, 1);
+      close(file);
+      eth_init &= ~'0';
+    }
+  }
+
+  printf("%d\nInitializing %s     - ", eth_init, eth_name);
+  if (ip65_init(eth_init)) {
+    ip65_error_exit();
+  }
+
+  // Abort on Ctrl-C to be consistent with Linenoise
+  abort_key = 0x83;
+
+  printf("Ok\nObtaining IP address         - ");
+  if (dhcp_init()) {
+    ip65_error_exit();
+  }
+
+  // Copy IP config from IP65 to W5100
+  w5100_init(eth_init);
+  w5100_config();
+
+  printf("Ok\nConnecting to %s (%u) - ", cfg_server, nntp_port);
+
+  if (!w5100_connect_addr(parse_dotted_quad(cfg_server), nntp_port)) {
+    printf("Fail\n");
+    error_exit();
+  }
+  online = 1;
+
+  printf("Ok\n\n");
+
+  if (!w5100_tcp_send_recv(sendbuf, DONT_SEND)) {
+    error_exit();
+  }
+  if (expect(buf, "20")) // "200" if posting is allowed / "201" if no posting
+    error_exit();
+
+  // Skip authentication?
+  if (strcmp(cfg_user, "-") != 0) {
+    sprintf(sendbuf, "AUTHINFO USER %s\r\n", cfg_user);
+    if (!w5100_tcp_send_recv(sendbuf, DO_SEND)) {
+      error_exit();
+    }
+    if (expect(buf, "381")) // Username accepted
+      error_exit();
+
+    sprintf(sendbuf, "AUTHINFO PASS %s\r\n", cfg_pass);
+    if (!w5100_tcp_send_recv(sendbuf, DO_SEND)) {
+      error_exit();
+    }
+    if (expect(buf, "281")) // Authentication successful
+      error_exit();
+  }
+}
+
+/*
+ * Get the time from the server as "yyyymmdd hhmmss", for NEWGROUPS
+ * Leaves stamp[] empty if the server does not support DATE.
+ */
+void get_server_date(void) {
+  stamp[0] = '\0';
+  if (!w5100_tcp_send_recv("DATE\r\n", DO_SEND)) {
+    error_exit();
+  }
+  if (strncmp(buf, "111 ", 4) || (strlen(buf) < 18))
+    return;
+  memcpy(stamp, buf + 4, 8);
+  stamp[8] = ' ';
+  memcpy(stamp + 9, buf + 12, 6);
+  stamp[15] = '\0';
+}
+
+/*
+ * Compare two entries by group name only, ignoring the flag
+ */
+int namecmp(char *a, char *b) {
+  while ((*a == *b) && (*a != ' ') && *a) {
+    ++a;
+    ++b;
+  }
+  if (((*a == ' ') || !*a) && ((*b == ' ') || !*b))
+    return 0;
+  return (uint8_t)*a - (uint8_t)*b;
+}
+
+/*
+ * Turn one line of LIST ACTIVE or NEWGROUPS into an entry
+ * Line is "name high low flag", entry is "name flag"
+ * Returns 1 if okay, 0 if the line can't be used
+ */
+uint8_t parse_active(char *l, char *e) {
+  char *p, *q;
+  p = strchr(l, ' ');
+  if (!p || (p == l) || (p - l > NAMESZ - 3))
+    return 0;
+  memcpy(e, l, p - l);
+  e[p - l] = ' ';
+  q = strchr(p + 1, ' ');
+  if (q)
+    q = strchr(q + 1, ' ');
+  e[p - l + 1] = ((q && (q[1] > ' ')) ? q[1] : 'y');
+  e[p - l + 2] = '\0';
+  return 1;
+}
+
+/*
+ * Open a file with a block buffer
+ * Returns 0 if okay, 1 if the file can't be opened
+ */
+uint8_t bopen(struct bfile *b, char *name, char *mode) {
+  if (mode[0] == 'w') {
+    _filetype = PRODOS_T_TXT;
+    _auxtype = 0;
+  }
+  b->fp = fopen(name, mode);
+  b->pos = b->end = 0;
+  return (b->fp == NULL);
+}
+
+/*
+ * Read the next entry from a file with a block buffer
+ * The zeros padding the end of each block of ACTIVE.DB are skipped.
+ * Returns 1 if okay, 0 at end of file
+ */
+uint8_t bgets(struct bfile *b, char *s) {
+  uint8_t i = 0;
+  char c;
+  while (1) {
+    if (b->pos == b->end) {
+      b->end = fread(b->buf, 1, BLKSZ, b->fp);
+      b->pos = 0;
+      if (b->end == 0) {
+        s[i] = '\0';
+        return (i > 0);
+      }
+    }
+    c = b->buf[b->pos++];
+    if ((c == '\r') || (c == '\n')) {
+      if (i) {
+        s[i] = '\0';
+        return 1;
+      }
+    } else if (c && (i < NAMESZ - 1))
+      s[i++] = c;
+  }
+}
+
+/*
+ * Write an entry, ending in CR, to a file with a block buffer
+ */
+void bputs(struct bfile *b, char *s) {
+  while (1) {
+    if (b->pos == BLKSZ) {
+      fwrite(b->buf, 1, BLKSZ, b->fp);
+      b->pos = 0;
+    }
+    b->buf[b->pos++] = (*s ? *s : '\r');
+    if (!*s++)
+      return;
+  }
+}
+
+/*
+ * Write out what is left in the buffer and close the file
+ */
+void bclose(struct bfile *b) {
+  if (b->pos && (b->end == 0))
+    fwrite(b->buf, 1, b->pos, b->fp);
+  fclose(b->fp);
+}
+
+/*
+ * Write an entry to ACTIVE.DB format
+ * An entry which does not fit in what is left of the block starts a new
+ * block, and the first entry of each block is added to the index.
+ */
+void db_put(char *s) {
+  uint8_t len = strlen(s) + 1;
+  if (out.pos + len > BLKSZ) {
+    memset(out.buf + out.pos, 0, BLKSZ - out.pos);
+    fwrite(out.buf, 1, BLKSZ, out.fp);
+    out.pos = 0;
+  }
+  if (out.pos == 0) {
+    strncpy(key, s, KEYSZ);
+    fwrite(key, 1, KEYSZ, idxfp);
+    ++nblocks;
+  }
+  memcpy(out.buf + out.pos, s, len - 1);
+  out.buf[out.pos + len - 1] = '\r';
+  out.pos += len;
+}
+
+/*
+ * Compare function for qsort()
+ */
+int sortcmp(const void *a, const void *b) {
+  return strcmp(*(char**)a, *(char**)b);
+}
+
+/*
+ * Sort the entries in the arena and write them to NEWS.SPOOL/RUN.n
+ */
+void run_flush(void) {
+  char **ptrs = (char**)(arena + arenasz) - numsort;
+  uint16_t i;
+  if (!numsort)
+    return;
+  qsort(ptrs, numsort, sizeof(char*), sortcmp);
+  sprintf(filename, "%s/NEWS.SPOOL/RUN.%u", cfg_emaildir, nruns++);
+  if (bopen(&out, filename, "wb")) {
+    printf("Can't create %s\n", filename);
+    error_exit();
+  }
+  for (i = 0; i < numsort; ++i)
+    bputs(&out, ptrs[i]);
+  bclose(&out);
+  arenaused = numsort = 0;
+}
+
+/*
+ * Add an entry to the arena, writing out a sorted run if it is full
+ * Entries grow up from the bottom of the arena and pointers to them
+ * grow down from the top.
+ */
+void run_add(char *s) {
+  uint8_t len = strlen(s) + 1;
+  char **ptrs;
+  if (arenaused + len + (numsort + 1) * sizeof(char*) > arenasz)
+    run_flush();
+  ptrs = (char**)(arena + arenasz) - ++numsort;
+  *ptrs = arena + arenaused;
+  memcpy(arena + arenaused, s, len);
+  arenaused += len;
+}
+
+/*
+ * Merge sorted files into one
+ * first - number of the first RUN.n to merge
+ * n     - number of runs to merge
+ * withdb - if 1, ACTIVE.DB is merged in too
+ * final - if 1, write ACTIVE.TMP and ACTIVE.ITMP, dropping duplicates,
+ *         otherwise write another RUN.n
+ */
+void merge(uint16_t first, uint8_t n, uint8_t withdb, uint8_t final) {
+  uint8_t i, k, min, more[MERGEWAY];
+  uint32_t done = 0;
+  entry[0] = '\0';
+  for (i = 0; i < n; ++i) {
+    sprintf(filename, "%s/NEWS.SPOOL/RUN.%u", cfg_emaildir, first + i);
+    if (bopen(&in[i], filename, "rb")) {
+      printf("Can't open %s\n", filename);
+      error_exit();
+    }
+  }
+  k = n;
+  if (withdb) {
+    sprintf(filename, "%s/ACTIVE.DB", cfg_emaildir);
+    if (bopen(&in[k++], filename, "rb")) {
+      printf("Can't open %s\n", filename);
+      error_exit();
+    }
+  }
+  if (final) {
+    sprintf(filename, "%s/ACTIVE.TMP", cfg_emaildir);
+    sprintf(filename2, "%s/ACTIVE.ITMP", cfg_emaildir);
+    _filetype = PRODOS_T_BIN;
+    _auxtype = 0;
+    idxfp = fopen(filename2, "wb");
+    nblocks = 0;
+  } else
+    sprintf(filename, "%s/NEWS.SPOOL/RUN.%u", cfg_emaildir, nruns++);
+  if (bopen(&out, filename, "wb") || (final && !idxfp)) {
+    printf("Can't create %s\n", filename);
+    error_exit();
+  }
+  for (i = 0; i < k; ++i)
+    more[i] = bgets(&in[i], line[i]);
+  while (1) {
+    min = 255;
+    for (i = 0; i < k; ++i)
+      if (more[i] && ((min == 255) || (strcmp(line[i], line[min]) < 0)))
+        min = i;
+    if (min == 255)
+      break;
+    if (!final)
+      bputs(&out, line[min]);
+    else if (!entry[0] || namecmp(line[min], entry)) {
+      db_put(line[min]);
+      strcpy(entry, line[min]);
+    }
+    if (!(++done & 0x1ff))
+      spinner(done, 0);
+    more[min] = bgets(&in[min], line[min]);
+  }
+  spinner(done, 1);
+  if (final) {
+    if (out.pos) {
+      memset(out.buf + out.pos, 0, BLKSZ - out.pos);
+      out.pos = BLKSZ;
+    }
+    fclose(idxfp);
+  }
+  bclose(&out);
+  for (i = 0; i < k; ++i)
+    fclose(in[i].fp);
+  for (i = 0; i < n; ++i) {
+    sprintf(filename, "%s/NEWS.SPOOL/RUN.%u", cfg_emaildir, first + i);
+    unlink(filename);
+  }
+}
+
+/*
+ * Merge all the runs, and ACTIVE.DB if withdb is 1, into a new ACTIVE.DB
+ * and ACTIVE.IDX. Only MERGEWAY files can be read at once, so runs are
+ * merged in groups until few enough are left for the final merge.
+ */
+void merge_all(uint8_t withdb) {
+  uint16_t first = 0;
+  uint8_t n;
+  free(arena);
+  while (nruns - first + withdb > MERGEWAY) {
+    n = (nruns - first > MERGEWAY ? MERGEWAY : nruns - first);
+    printf("Merging runs %u-%u         ", first, first + n - 1);
+    merge(first, n, 0, 0);
+    first += n;
+  }
+  printf("Writing ACTIVE.DB            ");
+  merge(first, nruns - first, withdb, 1);
+
+  sprintf(filename, "%s/ACTIVE.DB", cfg_emaildir);
+  sprintf(filename2, "%s/ACTIVE.TMP", cfg_emaildir);
+  unlink(filename);
+  if (rename(filename2, filename)) {
+    printf("Can't rename %s to %s\n", filename2, filename);
+    error_exit();
+  }
+  sprintf(filename, "%s/ACTIVE.IDX", cfg_emaildir);
+  sprintf(filename2, "%s/ACTIVE.ITMP", cfg_emaildir);
+  unlink(filename);
+  if (rename(filename2, filename)) {
+    printf("Can't rename %s to %s\n", filename2, filename);
+    error_exit();
+  }
+}
+
+/*
+ * Get memory for sorting
+ */
+void arena_alloc(void) {
+  arenasz = _heapmaxavail();
+  if (arenasz > MAXARENA)
+    arenasz = MAXARENA;
+  arena = malloc(arenasz);
+  if (!arena || (arenasz < 1024)) {
+    printf("Not enough memory\n");
+    error_exit();
+  }
+  arenaused = numsort = 0;
+  nruns = 0;
+}
+
+/*
+ * Save the server time of this update to ACTIVE.DATE
+ */
+void save_date(void) {
+  if (!stamp[0])
+    return;
+  sprintf(filename, "%s/ACTIVE.DATE", cfg_emaildir);
+  _filetype = PRODOS_T_TXT;
+  _auxtype = 0;
+  fp = fopen(filename, "wb");
+  if (fp) {
+    fprintf(fp, "%s\r", stamp);
+    fclose(fp);
+    fp = NULL;
+  }
+}
+
+/*
+ * Download the whole list of newsgroups and build ACTIVE.DB
+ * The list arrives in no particular order and is much too big to sort
+ * in memory, so it is cut into sorted runs which are then merged.
+ */
+void get_full_list(void) {
+  get_server_date();
+  if (!w5100_tcp_send_recv("LIST ACTIVE\r\n", DO_SEND)) {
+    error_exit();
+  }
+  if (expect(buf, "215"))
+    error_exit();
+  arena_alloc();
+  count = 0;
+  printf("Reading list of newsgroups   ");
+  while (1) {
+    if (!w5100_get_line(linebuf, LINEBUFSZ)) {
+      error_exit();
+    }
+    if (!strcmp(linebuf, ".\r\n"))
+      break;
+    if (!parse_active(linebuf, entry))
+      continue;
+    run_add(entry);
+    if (!(++count & 0xff))
+      spinner(count, 0);
+  }
+  spinner(count, 1);
+  run_flush();
+  merge_all(0);
+  sprintf(filename, "%s/ACTIVE.NEW", cfg_emaildir);
+  unlink(filename);
+  save_date();
+}
+
+/*
+ * Find the first block of ACTIVE.DB which can hold entries starting
+ * with prefix, by binary search of ACTIVE.IDX
+ * Returns the block number, or 0xffff if there is no list
+ */
+uint16_t find_block(char *prefix) {
+  uint16_t lo = 0, hi, mid;
+  sprintf(filename, "%s/ACTIVE.IDX", cfg_emaildir);
+  idxfp = fopen(filename, "rb");
+  if (!idxfp)
+    return 0xffff;
+  fseek(idxfp, 0, SEEK_END);
+  hi = ftell(idxfp) / KEYSZ;
+  // Find the first block whose first entry is not below prefix. Names
+  // starting with prefix may also be at the end of the block before.
+  while (lo < hi) {
+    mid = (lo + hi) / 2;
+    fseek(idxfp, (uint32_t)mid * KEYSZ, SEEK_SET);
+    fread(key, 1, KEYSZ, idxfp);
+    if (strncmp(key, prefix, KEYSZ) < 0)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  fclose(idxfp);
+  return (lo ? lo - 1 : 0);
+}
+
+/*
+ * Open ACTIVE.DB at the first block which can hold entries starting
+ * with prefix
+ * Returns 0 if okay, 1 if there is no list
+ */
+uint8_t db_open(char *prefix) {
+  uint16_t blk = find_block(prefix);
+  if (blk == 0xffff)
+    return 1;
+  sprintf(filename, "%s/ACTIVE.DB", cfg_emaildir);
+  if (bopen(&in[0], filename, "rb"))
+    return 1;
+  fseek(in[0].fp, (uint32_t)blk * BLKSZ, SEEK_SET);
+  return 0;
+}
+
+/*
+ * Check if a group is in ACTIVE.DB or ACTIVE.NEW
+ * Returns 1 if it is, 0 otherwise
+ */
+uint8_t is_known(char *e) {
+  int c = 1;
+  if (!db_open(e)) {
+    while (bgets(&in[0], line[0]))
+      if ((c = namecmp(line[0], e)) >= 0)
+        break;
+    fclose(in[0].fp);
+    if (c == 0)
+      return 1;
+  }
+  sprintf(filename, "%s/ACTIVE.NEW", cfg_emaildir);
+  if (bopen(&in[0], filename, "rb"))
+    return 0;
+  while (bgets(&in[0], line[0]))
+    if (!namecmp(line[0], e)) {
+      fclose(in[0].fp);
+      return 1;
+    }
+  fclose(in[0].fp);
+  return 0;
+}
+
+/*
+ * Get groups created since the last update with NEWGROUPS
+ * New groups are added to ACTIVE.NEW. Once it has more than NEWMAX
+ * entries it is sorted and merged into ACTIVE.DB.
+ */
+void get_new_groups(void) {
+  static char sendbuf[40];
+  static char since[16];
+  uint16_t numnew = 0;
+  FILE *newfp;
+  since[0] = '\0';
+  sprintf(filename, "%s/ACTIVE.DATE", cfg_emaildir);
+  fp = fopen(filename, "r");
+  if (fp) {
+    if ((fscanf(fp, "%8s", since) != 1) || (fscanf(fp, "%6s", since + 9) != 1))
+      since[0] = '\0';
+    since[8] = ' ';
+    fclose(fp);
+    fp = NULL;
+  }
+  // Without the time of the last update, start again from scratch
+  if (strlen(since) != 15) {
+    get_full_list();
+    return;
+  }
+  get_server_date();
+  sprintf(sendbuf, "NEWGROUPS %s GMT\r\n", since);
+  if (!w5100_tcp_send_recv(sendbuf, DO_SEND)) {
+    error_exit();
+  }
+  if (expect(buf, "231"))
+    error_exit();
+
+  // Count groups already waiting in ACTIVE.NEW
+  sprintf(filename, "%s/ACTIVE.NEW", cfg_emaildir);
+  if (!bopen(&in[0], filename, "rb")) {
+    while (bgets(&in[0], line[0]))
+      ++numnew;
+    fclose(in[0].fp);
+  }
+  count = 0;
+  while (1) {
+    if (!w5100_get_line(linebuf, LINEBUFSZ)) {
+      error_exit();
+    }
+    if (!strcmp(linebuf, ".\r\n"))
+      break;
+    if (!parse_active(linebuf, entry) || is_known(entry))
+      continue;
+    printf(" New group %s\n", entry);
+    sprintf(filename, "%s/ACTIVE.NEW", cfg_emaildir);
+    _filetype = PRODOS_T_TXT;
+    _auxtype = 0;
+    newfp = fopen(filename, "ab");
+    if (!newfp) {
+      printf("Can't open %s\n", filename);
+      error_exit();
+    }
+    fprintf(newfp, "%s\r", entry);
+    fclose(newfp);
+    ++numnew;
+    ++count;
+  }
+  printf("%lu new groups\n", count);
+
+  if (numnew > NEWMAX) {
+    arena_alloc();
+    sprintf(filename, "%s/ACTIVE.NEW", cfg_emaildir);
+    if (!bopen(&in[0], filename, "rb")) {
+      while (bgets(&in[0], entry))
+        run_add(entry);
+      fclose(in[0].fp);
+    }
+    run_flush();
+    merge_all(1);
+    sprintf(filename, "%s/ACTIVE.NEW", cfg_emaildir);
+    unlink(filename);
+  }
+  save_date();
+}
+
+/*
+ * Read a line from the keyboard
+ */
+void get_input(char *prompt, char *s, uint8_t n) {
+  printf("%s", prompt);
+  if (!fgets(s, n, stdin))
+    s[0] = '\0';
+  if (s[0])
+    s[strlen(s) - 1] = '\0'; // Eat '\r'
+}
+
+/*
+ * Create a mailbox, unless it already exists
+ * Returns 0 if okay, 1 on error
+ */
+uint8_t new_mailbox(char *mbox) {
+  sprintf(filename, "%s/%s/EMAIL.DB", cfg_emaildir, mbox);
+  fp = fopen(filename, "rb");
+  if (fp) {
+    fclose(fp);
+    fp = NULL;
+    return 0;
+  }
+  sprintf(filename, "%s/%s", cfg_emaildir, mbox);
+  if (mkdir(filename)) {
+    printf("Can't create dir %s\n", filename);
+    return 1;
+  }
+  sprintf(filename, "%s/%s/EMAIL.DB", cfg_emaildir, mbox);
+  _filetype = PRODOS_T_BIN;
+  _auxtype = 0;
+  fp = fopen(filename, "wb");
+  if (!fp) {
+    printf("Can't create %s\n", filename);
+    return 1;
+  }
+  fclose(fp);
+  sprintf(filename, "%s/%s/NEXT.EMAIL", cfg_emaildir, mbox);
+  _filetype = PRODOS_T_TXT;
+  _auxtype = 0;
+  fp = fopen(filename, "wb");
+  if (!fp) {
+    printf("Can't create %s\n", filename);
+    return 1;
+  }
+  fprintf(fp, "1");
+  fclose(fp);
+  fp = NULL;
+  return 0;
+}
+
+/*
+ * Subscribe to a newsgroup
+ * Asks for a mailbox, creates it, and adds the group to NEWSGROUPS.CFG
+ * by way of NEWSGROUPS.NEW, ahead of the "0" line which ends it, if any.
+ * e - entry for the group
+ */
+void subscribe(char *e) {
+  static char mbox[20];
+  char *p;
+  FILE *newfp;
+  uint8_t added = 0;
+  int c;
+  strcpy(entry, e);
+  *strchr(entry, ' ') = '\0';
+  printf("\nSubscribing to %s\n", entry);
+  get_input("Mailbox name (Return to cancel)> ", mbox, 17);
+  if (!mbox[0])
+    return;
+  for (p = mbox; *p; ++p) {
+    *p = toupper(*p);
+    if (!isalnum(*p) && (*p != '.'))
+      break;
+  }
+  if (*p || !isalpha(mbox[0]) || (strlen(mbox) > 15)) {
+    printf("Mailbox name must be up to 15 letters, digits and '.'\n");
+    return;
+  }
+
+  sprintf(filename, "%s/NEWSGROUPS.CFG", cfg_emaildir);
+  fp = fopen(filename, "r");
+  sprintf(filename2, "%s/NEWSGROUPS.NEW", cfg_emaildir);
+  _filetype = PRODOS_T_TXT;
+  _auxtype = 0;
+  newfp = fopen(filename2, "wb");
+  if (!newfp) {
+    printf("Can't open %s\n", filename2);
+    return;
+  }
+  if (fp) {
+    while (fscanf(fp, "%s", linebuf) == 1) {
+      if (!strcmp(linebuf, entry)) {
+        printf("Already subscribed to %s\n", entry);
+        fclose(fp);
+        fp = NULL;
+        fclose(newfp);
+        unlink(filename2);
+        return;
+      }
+      if (!strcmp(linebuf, "0")) {
+        fprintf(newfp, "%s %s 0\n", entry, mbox);
+        added = 1;
+        fprintf(newfp, "0\n");
+        continue;
+      }
+      fprintf(newfp, "%s", linebuf);
+      fscanf(fp, "%s", linebuf); // Mailbox
+      fprintf(newfp, " %s", linebuf);
+      fscanf(fp, "%s", linebuf); // Last article
+      fprintf(newfp, " %s", linebuf);
+      // Optional H flag, which would otherwise be read as the next group
+      while (1) {
+        c = fgetc(fp);
+        if ((c != ' ') && (c != '\t'))
+          break;
+      }
+      if (c == 'H')
+        fputs(" H", newfp);
+      else if (c != EOF)
+        ungetc(c, fp);
+      fputc('\n', newfp);
+    }
+    fclose(fp);
+    fp = NULL;
+  }
+  if (!added)
+    fprintf(newfp, "%s %s 0\n", entry, mbox);
+  fclose(newfp);
+
+  if (new_mailbox(mbox))
+    return;
+
+  sprintf(filename, "%s/NEWSGROUPS.CFG", cfg_emaildir);
+  unlink(filename);
+  if (rename(filename2, filename)) {
+    printf("Can't rename %s to %s\n", filename2, filename);
+    return;
+  }
+  printf("Subscribed to %s in mailbox %s\n", entry, mbox);
+}
+
+/*
+ * Show one group in a list of search results
+ */
+void show_group(uint8_t n, char *e) {
+  char *p = strchr(e, ' ');
+  *p = '\0';
+  printf(" %2u  %s", n + 1, e);
+  switch (p[1]) {
+  case 'm':
+    printf(" (moderated)");
+    break;
+  case 'n':
+  case 'x':
+    printf(" (read only)");
+    break;
+  }
+  putchar('\n');
+  *p = ' ';
+}
+
+/*
+ * Let the user pick a group from a page of search results
+ * Returns 1 if the search should go on, 0 if not
+ */
+uint8_t pick_group(uint8_t n, uint8_t more) {
+  static char ans[8];
+  uint8_t i;
+  while (1) {
+    get_input(more ? "\nNumber to subscribe, Return for more, Q to stop> "
+                   : "\nNumber to subscribe, Return to stop> ", ans, 6);
+    if (!ans[0])
+      return more;
+    if (toupper(ans[0]) == 'Q')
+      return 0;
+    i = atoi(ans);
+    if ((i >= 1) && (i <= n))
+      subscribe(found[i - 1]);
+  }
+}
+
+/*
+ * List the groups whose names start with prefix, a page at a time
+ * ACTIVE.DB is searched from the block found in the index, then the
+ * few groups in ACTIVE.NEW are checked one by one.
+ */
+void search(char *prefix) {
+  uint8_t plen = strlen(prefix), n = 0, pass;
+  int c;
+  putchar('\n');
+  for (pass = 0; pass < 2; ++pass) {
+    if (pass == 0) {
+      if (db_open(prefix)) {
+        printf("No list of newsgroups, use U to get one\n");
+        return;
+      }
+    } else {
+      sprintf(filename, "%s/ACTIVE.NEW", cfg_emaildir);
+      if (bopen(&in[0], filename, "rb"))
+        break;
+    }
+    while (bgets(&in[0], line[0])) {
+      c = strncmp(line[0], prefix, plen);
+      if (c < 0)
+        continue;
+      if (c > 0) {
+        if (pass == 0)
+          break; // ACTIVE.DB is sorted, so no more matches
+        continue;
+      }
+      strcpy(found[n], line[0]);
+      show_group(n, found[n]);
+      if (++n == PAGE) {
+        if (!pick_group(n, 1)) {
+          fclose(in[0].fp);
+          return;
+        }
+        n = 0;
+        putchar('\n');
+      }
+    }
+    fclose(in[0].fp);
+  }
+  if (n)
+    pick_group(n, 0);
+  else
+    printf("No more newsgroups starting with '%s'\n", prefix);
+}
+
+void main(int argc, char *argv[]) {
+  static char cmd[8];
+  static char prefix[NAMESZ];
+
+  if ((argc == 2) && (strcmp(argv[1], "EMAIL") == 0))
+    exec_email_on_exit = 1;
+
+  videomode(VIDEOMODE_80COL);
+  printf("%c%s NNTP - Find and Subscribe to Newsgroups%c\n", 0x0f, PROGNAME, 0x0e);
+
+  printf("\nReading NEWS.CFG             -");
+  readconfigfile();
+  printf(" Ok\n");
+
+  sprintf(filename, "%s/ACTIVE.DB", cfg_emaildir);
+  fp = fopen(filename, "rb");
+  if (fp) {
+    fclose(fp);
+    fp = NULL;
+  } else
+    printf("\nThere is no list of newsgroups yet. Use U to download it.\n"
+           "This only needs to be done once, but can take a long time.\n");
+
+  while (1) {
+    get_input("\nF)ind newsgroups, U)pdate list from server, Q)uit> ", cmd, 6);
+    switch (toupper(cmd[0])) {
+    case 'F':
+      get_input("Find newsgroups starting with> ", prefix, NAMESZ - 2);
+      search(prefix);
+      break;
+    case 'U':
+      go_online();
+      sprintf(filename, "%s/ACTIVE.DB", cfg_emaildir);
+      fp = fopen(filename, "rb");
+      if (fp) {
+        fclose(fp);
+        fp = NULL;
+        get_new_groups();
+      } else
+        get_full_list();
+      break;
+    case 'Q':
+      if (online) {
+        // Ignore any error - can be a race condition where other side
+        // disconnects too fast and we get an error
+        w5100_tcp_send_recv("QUIT\r\n", DO_SEND);
+        printf("Disconnecting\n");
+      }
+      confirm_exit();
+    }
+  }
+}
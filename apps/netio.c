@@ -0,0 +1,213 @@
+/////////////////////////////////////////////////////////////////
+// NETIO.C
+// Sending and receiving lines of text over the W5100, and sending
+// message bodies with CRLF line endings
+// Shared between smtp65.c, nntp65.c, nntp65.up.c and groups65.c
+/////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "../inc/ip65.h"
+#include "w5100.h"
+#include "netio.h"
+
+/*
+ * Send a null terminated string to the server, without waiting for
+ * any response
+ */
+bool w5100_send_text(char *sendbuf) {
+  uint16_t snd;
+  uint16_t pos = 0;
+  uint16_t len = strlen(sendbuf);
+
+  while (len) {
+    if (input_check_for_abort_key())
+    {
+      printf("User abort\n");
+      w5100_disconnect();
+      return false;
+    }
+
+    snd = w5100_send_request();
+    if (!snd) {
+      if (!w5100_connected()) {
+        printf("Connection lost\n");
+        return false;
+      }
+      continue;
+    }
+
+    if (len < snd)
+      snd = len;
+
+    {
+      // One less to allow for faster pre-increment below
+      const char *dataptr = sendbuf + pos - 1;
+      uint16_t i;
+      for (i = 0; i < snd; ++i) {
+        // The variable is necessary to have cc65 generate code
+        // suitable to access the W5100 auto-increment register.
+        char data = *++dataptr;
+        *w5100_data = data;
+      }
+    }
+
+    w5100_send_commit(snd);
+    len -= snd;
+    pos += snd;
+  }
+  return true;
+}
+
+/*
+ * Read one line from the server, up to and including CRLF
+ * Only the bytes of the line are taken from the W5100, so whatever
+ * follows is left for the next read.
+ * line - buffer to write the null terminated line to. Longer lines are
+ *        truncated.
+ * n    - size of line[]
+ */
+bool w5100_get_line(char *line, uint16_t n) {
+  uint16_t rcv, i, len = 0;
+  while (1) {
+    if (input_check_for_abort_key()) {
+      printf("User abort\n");
+      w5100_disconnect();
+      return false;
+    }
+
+    rcv = w5100_receive_request();
+    if (!rcv) {
+      if (!w5100_connected()) {
+        printf("Connection lost\n");
+        return false;
+      }
+      continue;
+    }
+
+    for (i = 0; i < rcv; ) {
+      // The variable is necessary to have cc65 generate code
+      // suitable to access the W5100 auto-increment register.
+      char data = *w5100_data;
+      ++i;
+      if (len < n - 1)
+        line[len++] = data;
+      if (data == '\n') {
+        w5100_receive_commit(i);
+        line[len] = '\0';
+        return true;
+      }
+    }
+    w5100_receive_commit(rcv);
+  }
+}
+
+static uint8_t bol;     // At beginning of line
+static uint8_t lastcr;  // Last char from the file was CR
+
+/*
+ * Start sending a new message body with w5100_send_crlf()
+ */
+void w5100_crlf_start(void) {
+  bol = 1;
+  lastcr = 0;
+}
+
+/*
+ * Number of bytes p[0..end-1] will occupy on the wire once line endings
+ * have been expanded to CRLF by w5100_send_crlf() (without dot-stuffing)
+ */
+uint16_t crlf_size(char *p, uint16_t end) {
+  uint16_t i, size = 0;
+  uint8_t cr = lastcr;
+  char c;
+  for (i = 0; i < end; ++i) {
+    c = p[i];
+    if ((c == '\n') && cr) {
+      cr = 0;
+      continue;
+    }
+    cr = (c == '\r');
+    size += ((c == '\r') || (c == '\n') ? 2 : 1);
+  }
+  return size;
+}
+
+/*
+ * Send p[0..end-1], which holds a block read from a message file
+ * The block is written straight into the W5100 TX buffer in chunks as
+ * large as the buffer has room for. On the way CR line endings are
+ * expanded to CRLF (LF or CRLF endings in the file are also handled) and,
+ * if dotstuff is set, lines starting with '.' have another '.' added.
+ * Line state carries over from one block to the next, back to the last
+ * call of w5100_crlf_start().
+ */
+bool w5100_send_crlf(char *p, uint16_t end, uint8_t dotstuff) {
+  uint16_t rd = 0;      // Read position in p[]
+  uint16_t snd;
+  uint16_t i;
+  char     pending = 0; // Extra char to send before reading more
+  char     c;
+
+  while ((rd < end) || pending) {
+    if (input_check_for_abort_key())
+    {
+      printf("User abort\n");
+      w5100_disconnect();
+      return false;
+    }
+
+    snd = w5100_send_request();
+    if (!snd) {
+      if (!w5100_connected()) {
+        printf("Connection lost\n");
+        return false;
+      }
+      continue;
+    }
+
+    i = 0;
+    while (i < snd) {
+      if (pending) {
+        c = pending;
+        pending = 0;
+      } else {
+        if (rd == end)
+          break;
+        c = p[rd++];
+        if ((c == '\n') && lastcr) { // LF of a CRLF pair, already sent
+          lastcr = 0;
+          continue;
+        }
+        lastcr = (c == '\r');
+        if (c == '\n')
+          c = '\r';               // Bare LF, send CRLF
+        if (c == '\r')
+          pending = '\n';
+        else if (dotstuff && bol && (c == '.'))
+          pending = '.';
+        bol = (c == '\r');
+      }
+      {
+        // The variable is necessary to have cc65 generate code
+        // suitable to access the W5100 auto-increment register.
+        char data = c;
+        *w5100_data = data;
+      }
+      ++i;
+    }
+
+    w5100_send_commit(i);
+  }
+  return true;
+}
+
+/*
+ * Send the "." line which ends a dot-stuffed body, first ending the last
+ * line of the body if it had no line ending
+ */
+bool w5100_send_dot(void) {
+  return w5100_send_text(bol ? ".\r\n" : "\r\n.\r\n");
+}
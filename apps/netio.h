@@ -0,0 +1,21 @@
+/////////////////////////////////////////////////////////////////
+// NETIO.H
+// Sending and receiving lines of text over the W5100, and sending
+// message bodies with CRLF line endings
+// Shared between smtp65.c, nntp65.c, nntp65.up.c and groups65.c
+/////////////////////////////////////////////////////////////////
+
+#ifndef _NETIO_H_
+#define _NETIO_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+bool w5100_send_text(char *sendbuf);
+bool w5100_get_line(char *line, uint16_t n);
+void w5100_crlf_start(void);
+uint16_t crlf_size(char *p, uint16_t end);
+bool w5100_send_crlf(char *p, uint16_t end, uint8_t dotstuff);
+bool w5100_send_dot(void);
+
+#endif
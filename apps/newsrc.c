@@ -0,0 +1,128 @@
+/////////////////////////////////////////////////////////////////
+// NEWSRC.C
+// Sets of article numbers stored as ranges, like .newsrc
+// Shared between nntp65.c and email.c
+/////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <apple2_filetype.h>
+
+#include "newsrc.h"
+
+/*
+ * Load a set from a file
+ * The file is one line of ranges separated by commas, for example
+ * 1-200,203,205-310
+ * fname - file to read
+ * s     - set to fill in, empty if the file does not exist
+ * Returns 1 if the file was read, 0 if it does not exist
+ */
+uint8_t newsrc_load(char *fname, struct newsrc *s) {
+  FILE *fp;
+  uint32_t lo, hi;
+  int c;
+  s->n = 0;
+  fp = fopen(fname, "r");
+  if (!fp)
+    return 0;
+  while (fscanf(fp, "%lu", &lo) == 1) {
+    hi = lo;
+    c = fgetc(fp);
+    if (c == '-') {
+      if (fscanf(fp, "%lu", &hi) != 1)
+        break;
+      c = fgetc(fp);
+    }
+    if (hi >= lo)
+      newsrc_add(s, lo, hi);
+    if (c != ',')
+      break;
+  }
+  fclose(fp);
+  return 1;
+}
+
+/*
+ * Save a set to a file, in the format read by newsrc_load()
+ * Returns 0 if okay, 1 on error
+ */
+uint8_t newsrc_save(char *fname, struct newsrc *s) {
+  FILE *fp;
+  uint8_t i;
+  _filetype = PRODOS_T_TXT;
+  _auxtype = 0;
+  fp = fopen(fname, "wb");
+  if (!fp)
+    return 1;
+  for (i = 0; i < s->n; ++i) {
+    if (i)
+      fputc(',', fp);
+    if (s->r[i].lo == s->r[i].hi)
+      fprintf(fp, "%lu", s->r[i].lo);
+    else
+      fprintf(fp, "%lu-%lu", s->r[i].lo, s->r[i].hi);
+  }
+  fputc('\r', fp);
+  fclose(fp);
+  return 0;
+}
+
+/*
+ * Check if num is in the set
+ * Returns 1 if it is, 0 otherwise
+ */
+uint8_t newsrc_has(struct newsrc *s, uint32_t num) {
+  return newsrc_covers(s, num, num);
+}
+
+/*
+ * Check if all of lo..hi is in the set
+ * Returns 1 if it is, 0 otherwise
+ */
+uint8_t newsrc_covers(struct newsrc *s, uint32_t lo, uint32_t hi) {
+  uint8_t i;
+  for (i = 0; i < s->n; ++i) {
+    if (s->r[i].hi >= lo)
+      return ((s->r[i].lo <= lo) && (s->r[i].hi >= hi));
+  }
+  return 0;
+}
+
+/*
+ * Add lo..hi to the set, merging with any ranges it overlaps or touches
+ * If the set is full, the lowest range is forgotten to make room. These
+ * are the oldest articles, which soon expire anyway. Filling in a gap
+ * instead would add articles which were never given.
+ */
+void newsrc_add(struct newsrc *s, uint32_t lo, uint32_t hi) {
+  uint8_t i, j;
+  // Skip ranges which end before lo - 1
+  for (i = 0; (i < s->n) && (s->r[i].hi + 1 < lo); ++i);
+  // Merge with ranges which start no later than hi + 1
+  for (j = i; (j < s->n) && (s->r[j].lo <= hi + 1); ++j) {
+    if (s->r[j].lo < lo)
+      lo = s->r[j].lo;
+    if (s->r[j].hi > hi)
+      hi = s->r[j].hi;
+  }
+  if (i == j) {
+    // New range goes in before r[i]
+    if (s->n == NEWSRC_MAX) {
+      if (i == 0)
+        return;     // New range is the lowest, so it is the one forgotten
+      memmove(&s->r[0], &s->r[1], (NEWSRC_MAX - 1) * sizeof(struct range));
+      --s->n;
+      --i;
+    }
+    memmove(&s->r[i + 1], &s->r[i], (s->n - i) * sizeof(struct range));
+    ++s->n;
+  } else if (j > i + 1) {
+    // r[i] .. r[j - 1] become one range
+    memmove(&s->r[i + 1], &s->r[j], (s->n - j) * sizeof(struct range));
+    s->n -= j - i - 1;
+  }
+  s->r[i].lo = lo;
+  s->r[i].hi = hi;
+}
@@ -0,0 +1,37 @@
+/////////////////////////////////////////////////////////////////
+// NEWSRC.H
+// Sets of article numbers stored as ranges, like .newsrc
+// Shared between nntp65.c and email.c
+/////////////////////////////////////////////////////////////////
+
+#ifndef _NEWSRC_H_
+#define _NEWSRC_H_
+
+#include <stdint.h>
+
+#define NEWSRC_MAX 128  // Max number of ranges in a set
+
+// Files in the mailbox of a newsgroup
+#define NEWSRC_FETCHED "NEWS.FETCHED"  // Articles already downloaded
+#define NEWSRC_READ    "NEWS.READ"     // Articles read (by EMAIL.n number)
+
+// One run of consecutive article numbers
+struct range {
+  uint32_t lo;
+  uint32_t hi;
+};
+
+// Set of article numbers, as ranges sorted in ascending order
+// which neither overlap nor touch
+struct newsrc {
+  uint8_t      n;
+  struct range r[NEWSRC_MAX];
+};
+
+uint8_t newsrc_load(char *fname, struct newsrc *s);
+uint8_t newsrc_save(char *fname, struct newsrc *s);
+uint8_t newsrc_has(struct newsrc *s, uint32_t num);
+uint8_t newsrc_covers(struct newsrc *s, uint32_t lo, uint32_t hi);
+void newsrc_add(struct newsrc *s, uint32_t lo, uint32_t hi);
+
+#endif
@@ -9,7 +9,6 @@
 #include <cc65.h>
 #include <errno.h>
 #include <ctype.h>
-#include <dirent.h>
 #include <fcntl.h>
 #include <conio.h>
 #include <stdio.h>
@@ -22,6 +21,10 @@
 #include "w5100.h"
 
 #include "email_common.h"
+#include "chain.h"
+#include "netio.h"
+#include "codec.h"
+#include "newsrc.h"
 
 #define BELL      7
 #define BACKSPACE 8
@@ -35,20 +38,32 @@
 
 #define NETBUFSZ  1500+4       // 4 extra bytes for overlap between packets
 #define LINEBUFSZ 2000 /*1000*/         // According to RFC2822 Section 2.1.1 (998+CRLF)
-#define READSZ    1024         // Must be less than NETBUFSZ to fit in buf[]
+#define OVERCHUNK 50           // Number of articles per XOVER request
+#define WINDOW    4            // Default number of ARTICLE requests in flight
 
 static unsigned char buf[NETBUFSZ+1];    // One extra byte for null terminator
-static char          linebuf_pad[1];     // One byte of padding make it easier
 static char          linebuf[LINEBUFSZ];
 static char          newsgroup[80];
 static char          mailbox[80];
 
 uint8_t  exec_email_on_exit = 0;
+uint8_t  chained = 0;     // 1 if run as part of SYNC65
 char     filename[80];
 int      len;
 FILE     *fp, *newsgroupsfp, *newnewsgroupsfp;
 uint32_t filesize;
 uint16_t nntp_port;
+uint32_t wanted[OVERCHUNK];    // Numbers of articles to fetch, 0 if gone
+uint8_t  numwanted;            // Number of entries in wanted[]
+uint8_t  have_over = 1;        // 0 if server does not support XOVER
+uint8_t  have_hdr = 1;         // 0 if server supports neither HDR nor XHDR
+char     *hdrcmd = "HDR";      // "HDR" or "XHDR", whichever the server has
+uint16_t window;               // Max number of ARTICLE requests in flight
+char     *getmbox = NULL;      // Mailbox for GET, NULL if not fetching
+uint16_t getnum;               // Message number for GET
+uint8_t  failed = 0;           // 1 if exiting because of an error
+struct newsrc fetched;         // Articles already fetched for this newsgroup
+char     fetchedname[80];      // Name of file fetched is kept in
 
 /*
  * Keypress before quit
@@ -58,8 +73,13 @@ void confirm_exit(void) {
   fclose(newsgroupsfp);
   fclose(newnewsgroupsfp);
   w5100_disconnect();
-  printf("\n[Press Any Key]");
-  cgetc();
+  if (chained)
+    chain_exec(cfg_instdir, CHAIN_NNTP_UP, exec_email_on_exit);
+  // Go straight back to the pager once an article has been fetched
+  if (!getmbox || failed) {
+    printf("\n[Press Any Key]");
+    cgetc();
+  }
   if (exec_email_on_exit) {
     sprintf(filename, "%s/EMAIL.SYSTEM", cfg_instdir);
     exec(filename, NULL);
@@ -71,6 +91,7 @@ void confirm_exit(void) {
  * Called for all non IP65 errors
  */
 void error_exit() {
+  failed = 1;
   confirm_exit();
 }
 
@@ -79,6 +100,7 @@ void error_exit() {
  */
 void ip65_error_exit(void) {
   printf("%s\n", ip65_strerror(ip65_error));
+  failed = 1;
   confirm_exit();
 }
 
@@ -116,186 +138,35 @@ void spinner(uint32_t sz, uint8_t final) {
 
 #define DO_SEND   1  // For do_send param
 #define DONT_SEND 0  // For do_send param
-#define CMD_MODE  0  // For mode param
-#define DATA_MODE 1  // For mode param
 
 // Modified verson of w5100_http_open from w5100_http.c
-// Sends a TCP message and receives a the first packet of the response.
+// Sends a TCP message and receives the response.
+// Only the response itself is taken from the W5100, so further responses
+// to pipelined commands are left to be read by the next call.
 // sendbuf is the buffer to send (null terminated)
 // recvbuf is the buffer into which the received message will be written
 // length is the length of recvbuf[]
 // do_send Do the sending if true, otherwise skip
-// mode Binary mode for received message, maybe first block of long message
 bool w5100_tcp_send_recv(char* sendbuf, char* recvbuf, size_t length,
-                         uint8_t do_send, uint8_t mode) {
+                         uint8_t do_send) {
 
   if (do_send == DO_SEND) {
-    uint16_t snd;
-    uint16_t pos = 0;
-    uint16_t len = strlen(sendbuf);
-
     if (strncmp(sendbuf, "AUTHINFO PASS", 13) == 0)
       printf(">AUTHINFO PASS ****\n");
     else {
       putchar('>');
       print_strip_crlf(sendbuf);
     }
-
-    while (len) {
-      if (input_check_for_abort_key())
-      {
-        printf("User abort\n");
-        w5100_disconnect();
-        return false;
-      }
-
-      snd = w5100_send_request();
-      if (!snd) {
-        if (!w5100_connected()) {
-          printf("Connection lost\n");
-          return false;
-        }
-        continue;
-      }
-
-      if (len < snd)
-        snd = len;
-
-      {
-        // One less to allow for faster pre-increment below
-        const char *dataptr = sendbuf + pos - 1;
-        uint16_t i;
-        for (i = 0; i < snd; ++i) {
-          // The variable is necessary to have cc65 generate code
-          // suitable to access the W5100 auto-increment register.
-          char data = *++dataptr;
-          *w5100_data = data;
-        }
-      }
-
-      w5100_send_commit(snd);
-      len -= snd;
-      pos += snd;
-    }
+    if (!w5100_send_text(sendbuf))
+      return false;
   }
 
-  if (mode == DATA_MODE) {
-    //
-    // Handle article body
-    //
-    uint16_t rcv, written;
-    uint16_t len = 0;
-    uint8_t cont = 1;
-
-    // Backspace to put spinner on same line as RETR
-    for (rcv = 0; rcv < 15; ++rcv)
-      putchar(BACKSPACE);
-
-    filesize = 0;
-
-    // Initialize 4 byte overlap to zero
-    bzero(recvbuf, 4);
-
-    while (cont) {
-      if (input_check_for_abort_key()) {
-        printf("User abort\n");
-        w5100_disconnect();
-        return false;
-      }
-    
-      rcv = w5100_receive_request();
-      if (!rcv) {
-        cont = w5100_connected();
-        if (cont)
-          continue;
-      }
-
-      if (rcv > length - len)
-        rcv = length - len;
-
-      {
-        // One less to allow for faster pre-increment below
-        // 4 bytes of overlap between blocks
-        char *dataptr = recvbuf + len + 4 - 1;
-        uint16_t i;
-        for (i = 0; i < rcv; ++i) {
-          // The variable is necessary to have cc65 generate code
-          // suitable to access the W5100 auto-increment register.
-          char data = *w5100_data;
-          *++dataptr = data;
-          if (!memcmp(dataptr - 4, "\r\n.\r\n", 5))
-            cont = 0;
-        }
-      }
-      w5100_receive_commit(rcv);
-      len += rcv;
-
-      // Skip 4 byte overlap
-      written = fwrite(recvbuf + 4, 1, len, fp);
-      if (written != len) {
-        printf("Write error");
-        return false;
-      }
-
-      // Copy 4 bytes of overlap
-      memcpy(recvbuf, recvbuf + len, 4);
-
-      filesize += len;
-      spinner(filesize, 0);
-      len = 0;
-    }
-  } else {
-    //
-    // Handle short single line ASCII text responses
-    // Must fit in recvbuf[]
-    //
-    uint16_t rcv;
-    uint16_t len = 0;
-    uint8_t cont = 1;
-
-    --length; // Leave space for NULL at end in case of buffer overrun
-
-    while (cont) {
-      if (input_check_for_abort_key()) {
-        printf("User abort\n");
-        w5100_disconnect();
-        return false;
-      }
-    
-      rcv = w5100_receive_request();
-      if (!rcv) {
-        cont = w5100_connected();
-        if (cont)
-          continue;
-      }
-
-      if ((length - len) == 0)
-        cont = 0;
-
-      if (rcv > length - len)
-        rcv = length - len;
-
-      {
-        // One less to allow for faster pre-increment below
-        // 4 bytes of overlap between blocks
-        char *dataptr = recvbuf + len - 1;
-        uint16_t i;
-        for (i = 0; i < rcv; ++i) {
-          // The variable is necessary to have cc65 generate code
-          // suitable to access the W5100 auto-increment register.
-          char data = *w5100_data;
-          *++dataptr = data;
-          if (!memcmp(dataptr - 1, "\r\n", 2))
-            cont = 0;
-        }
-      }
-      w5100_receive_commit(rcv);
-      len += rcv;
-    }
-    recvbuf[len + 1] = '\0';
-    putchar('<');
-    print_strip_crlf(recvbuf);
-  }
+  // Handle short single line ASCII text responses
+  // Must fit in recvbuf[]
+  if (!w5100_get_line(recvbuf, length))
+    return false;
+  putchar('<');
+  print_strip_crlf(recvbuf);
   return true;
 }
 
@@ -325,6 +196,12 @@ void readconfigfile(void) {
   fscanf(fp, "%s", cfg_pass);
   fscanf(fp, "%s", cfg_instdir);
   fscanf(fp, "%s", cfg_emaildir);
+  fscanf(fp, "%s", cfg_emailaddr);
+  // Optional seventh line sets how many articles are requested at once
+  if ((fscanf(fp, "%u", &window) != 1) || (window == 0))
+    window = WINDOW;
+  if (window > OVERCHUNK)
+    window = OVERCHUNK;
   fclose(fp);
 
   colon = strchr(cfg_server, ':');
@@ -336,81 +213,102 @@ void readconfigfile(void) {
   }
 }
 
+/*
+ * Read one line of a text file
+ * Lines may end in CR (as written by Apple II editors), LF or CRLF. The
+ * line ending is not stored. CRLF gives an extra empty line.
+ * fp - file to read from
+ * line - buffer to write the null terminated line to. Longer lines are
+ *        truncated.
+ * n - size of line[]
+ * Returns 0 at end of file, 1 otherwise
+ */
+uint8_t read_text_line(FILE *fp, char *line, uint16_t n) {
+  uint16_t i = 0;
+  int c;
+  while ((c = fgetc(fp)) != EOF) {
+    if ((c == '\r') || (c == '\n')) {
+      line[i] = '\0';
+      return 1;
+    }
+    if (i < n - 1)
+      line[i++] = c;
+  }
+  line[i] = '\0';
+  return (i > 0);
+}
+
 // Entry on kill-list
 struct killent {
-  char *address;
   struct killent *next;
+  char pattern[1];         // Allocated to fit, null terminated
 };
 
-struct killent *killlist = NULL;
+#define KILLHASH 32        // Number of hash buckets, must be power of 2
+
+// Exact addresses (user@host) and domains (@host) are hashed, and are
+// compared in lower case. The other kinds of entry are substring patterns.
+struct killent *killaddr[KILLHASH];
+struct killent *killfrom = NULL;     // Substring of From header
+struct killent *killsubj = NULL;     // Substring of Subject header
+struct killent *killmsgid = NULL;    // Substring of Message-ID header
 
 /*
- * Read email addresses from KILL.LIST.CFG
+ * Hash function for kill-list addresses
+ */
+uint8_t kill_hash(char *s) {
+  uint8_t h = 0;
+  while (*s)
+    h = ((h << 1) | (h >> 7)) ^ *s++;
+  return h & (KILLHASH - 1);
+}
+
+/*
+ * Add a pattern to the front of a kill-list chain
+ */
+void kill_add(struct killent **list, char *s) {
+  struct killent *p = malloc(sizeof(struct killent) + strlen(s));
+  if (!p)
+    return;
+  strcpy(p->pattern, s);
+  p->next = *list;
+  *list = p;
+}
+
+/*
+ * Read kill patterns from KILL.LIST.CFG
+ * Each line is one of:
+ *   user@host           - From this exact address
+ *   @host               - From any address at host or its subdomains
+ *   Subject: text       - Subject contains text
+ *   Message-ID: text    - Message-ID contains text
+ *   text                - From header contains text
  * Returns 0 if kill-list exists, 1 if it does not
  */
 uint8_t readkilllist(void) {
-  struct killent *p, *q;
   char *s;
   fp = fopen("KILL.LIST.CFG", "r");
   if (!fp)
     return 1;
-  killlist = p = malloc(sizeof(struct killent));
-  killlist->address = NULL;
-  killlist->next = NULL;
-  while (!feof(fp)) {
-    fscanf(fp, "%s", linebuf);
-    s = malloc(strlen(linebuf) + 1);
-    strcpy(s, linebuf);
-    q = malloc(sizeof(struct killent));
-    q->address = s;
-    q->next = NULL;
-    p->next = q;
-    p = q;
+  while (read_text_line(fp, linebuf, LINEBUFSZ)) {
+    if (linebuf[0] == '\0')
+      continue;
+    if (!strncmp(linebuf, "Subject: ", 9))
+      kill_add(&killsubj, linebuf + 9);
+    else if (!strncmp(linebuf, "Message-ID: ", 12))
+      kill_add(&killmsgid, linebuf + 12);
+    else if (strchr(linebuf, '@') && !strchr(linebuf, ' ')) {
+      for (s = linebuf; *s; ++s)
+        *s = tolower(*s);
+      kill_add(&killaddr[kill_hash(linebuf)], linebuf);
+    } else
+      kill_add(&killfrom, linebuf);
   }
   fclose(fp);
+  fp = NULL;
   return 0;
 }
 
-/*
- * Read a text file a line at a time
- * Returns number of chars in the line, or 0 if EOF.
- * Expects CRLF line endings (CRLF) and converts to Apple II (CR) convention
- * fp - file to read from
- * writep - Pointer to buffer into which line will be written
- * n - length of buffer. Longer lines will be truncated and terminated with CR.
- */
-uint16_t get_line(FILE *fp, char *writep, uint16_t n) {
-  static uint16_t rd = 0; // Read
-  static uint16_t end = 0; // End of valid data in buf
-  uint16_t i = 0;
-  // Special case, if fp is NULL then reset the state
-  if (!fp) {
-    rd = end = 0;
-    return 0;
-  }
-  while (1) {
-    if (rd == end) {
-      end = fread(buf, 1, READSZ, fp);
-      rd = 0;
-    }
-    if (end == 0)
-      goto done;
-    writep[i++] = buf[rd++];
-    if (i == n - 1) {
-      writep[i - 1] = '\r';
-      goto done;
-    }
-    // The following line is safe because of linebuf_pad[]
-    if ((writep[i - 1] == '\n') && (writep[i - 2] == '\r')) {
-      writep[i - 1] = '\0'; // Remove LF
-      return i - 1;
-    }
-  }
-done:
-  writep[i] = '\0';
-  return i;
-}
-
 /*
  * Update EMAIL.DB - quick access database for header info
  */
@@ -461,14 +359,26 @@ void write_next_email(uint16_t num) {
 #endif
 
 /*
- * Check if a sender is on the kill-list.
- * sender - email address of sender
- * Returns 1 if on kill-list, false otherwise.
+ * Check if s contains any of the patterns on a kill-list chain
+ * Returns 1 if it does, 0 otherwise
+ */
+uint8_t kill_substr(struct killent *p, char *s) {
+  while (p) {
+    if (strstr(s, p->pattern))
+      return 1;
+    p = p->next;
+  }
+  return 0;
+}
+
+/*
+ * Check if key is one of the hashed kill-list addresses
+ * Returns 1 if it is, 0 otherwise
  */
-uint8_t sender_is_on_killlist(char *sender) {
-  struct killent *p = killlist;
-  while (p && p->next) {
-    if (strstr(sender, p->address))
+uint8_t kill_lookup(char *key) {
+  struct killent *p = killaddr[kill_hash(key)];
+  while (p) {
+    if (!strcmp(key, p->pattern))
       return 1;
     p = p->next;
   }
@@ -476,110 +386,472 @@ uint8_t sender_is_on_killlist(char *sender) {
 }
 
 /*
- * Update mailbox
- * Copy messages from spool dir to mailbox and find headers of interest
- * (Date, From, Subject)
+ * Check if an article is on the kill-list.
+ * The address is taken from between '<' and '>' in the From header if
+ * present, otherwise it is the first word. It is looked up as it is, then
+ * as @host, then as @ each parent domain of host.
+ * from  - From header
+ * subj  - Subject header
+ * msgid - Message-ID header, may be NULL
+ * Returns 1 if on kill-list, 0 otherwise.
+ */
+uint8_t is_on_killlist(char *from, char *subj, char *msgid) {
+  static char addr[80];
+  char *p, *q;
+  if (kill_substr(killfrom, from) || kill_substr(killsubj, subj))
+    return 1;
+  if (msgid && kill_substr(killmsgid, msgid))
+    return 1;
+  p = strchr(from, '<');
+  p = (p ? p + 1 : from);
+  for (q = addr; *p && (*p != '>') && (*p != ' ') && (q < addr + 79); ++p)
+    *q++ = tolower(*p);
+  *q = '\0';
+  if (kill_lookup(addr))
+    return 1;
+  p = strchr(addr, '@');
+  while (p) {
+    *p = '@';          // Overwrites the user part, or the '.' before p
+    if (kill_lookup(p))
+      return 1;
+    p = strchr(p + 1, '.');
+  }
+  return 0;
+}
+
+/*
+ * Split off the next tab separated field of an overview line
+ * p - pointer into the line, advanced past the field
+ * Returns the field, null terminated
+ */
+char *over_field(char **p) {
+  char *f = *p, *t = strchr(f, '\t');
+  if (t) {
+    *t = '\0';
+    *p = t + 1;
+  } else
+    *p = f + strlen(f);
+  return f;
+}
+
+/*
+ * Fill in headers from one line of XOVER output
+ * The fields are number, subject, from, date, message-id, references,
+ * bytes and lines.
+ * Returns the article number
+ */
+uint32_t parse_overview(char *line, struct emailhdrs *h) {
+  char *p = line;
+  uint32_t num = atol(over_field(&p));
+  memset(h, 0, sizeof(struct emailhdrs));
+  h->emailnum = num;
+  h->status = 'N';
+  h->tag = ' ';
+  decode_header(h->subject, over_field(&p), 80);
+  decode_header(h->from, over_field(&p), 80);
+  copyheader(h->date, over_field(&p), 39);
+  h->date[39] = '\0';
+  // Message-ID, only used for header-only newsgroups
+  copyheader(h->cc, over_field(&p), 79);
+  h->cc[79] = '\0';
+  // Store News:newsgroup in TO field
+  strcpy(linebuf, "News:");
+  strcat(linebuf, newsgroup);
+  copyheader(h->to, linebuf, 79);
+  return num;
+}
+
+/*
+ * Get the overview of articles first..last and decide which to fetch
+ * Articles on the kill-list, and those already fetched, are dropped here,
+ * before they are downloaded. The headers of the articles to be fetched
+ * are written to NEWS.SPOOL/OVERVIEW.DB in the same order as wanted[].
+ * Returns 1 if the server does not support XOVER, 2 if it refused the
+ * command for some other reason, 0 otherwise
  */
-void update_mailbox(char *mbox) {
+uint8_t get_overview(uint32_t first, uint32_t last) {
   static struct emailhdrs hdrs;
-  struct dirent *d;
-  uint16_t msg, chars, headerchars;
-  uint8_t headers, onkilllist;
-  FILE *destfp;
-  DIR *dp;
-  sprintf(filename, "%s/NEWS.SPOOL", cfg_emaildir);
-  dp = opendir(filename);
-  while (d = readdir(dp)) {
-    strcpy(linebuf, "");
-    sprintf(filename, "%s/NEWS.SPOOL/%s", cfg_emaildir, d->d_name);
-    get_line(NULL, NULL, 0); // Reset get_line() state
-    fp = fopen(filename, "r");
-    if (!fp) {
-      printf("Can't open %s\n", filename);
-      closedir(dp);
+  static char sendbuf[30];
+  uint32_t num;
+  FILE *ovfp;
+  numwanted = 0;
+  sprintf(sendbuf, "XOVER %lu-%lu\r\n", first, last);
+  if (!w5100_tcp_send_recv(sendbuf, buf, NETBUFSZ, DO_SEND)) {
+    error_exit();
+  }
+  if (!strncmp(buf, "420", 3) || !strncmp(buf, "423", 3))
+    return 0; // No articles in range
+  if (!strncmp(buf, "500", 3) || !strncmp(buf, "501", 3))
+    return 1; // Unknown command or syntax
+  if (strncmp(buf, "224", 3))
+    return 2;
+  sprintf(filename, "%s/NEWS.SPOOL/OVERVIEW.DB", cfg_emaildir);
+  _filetype = PRODOS_T_BIN;
+  _auxtype = 0;
+  ovfp = fopen(filename, "wb");
+  if (!ovfp) {
+    printf("Can't create %s\n", filename);
+    error_exit();
+  }
+  while (1) {
+    if (!w5100_get_line(linebuf, LINEBUFSZ)) {
       error_exit();
     }
-    hdrs.emailnum = msg = atoi(&(d->d_name[5]));
-    sprintf(filename, "%s/%s/EMAIL.%u", cfg_emaildir, mbox, msg);
-    fputs(filename, stdout);
-    _filetype = PRODOS_T_TXT;
-    _auxtype = 0;
-    destfp = fopen(filename, "wb");
-    if (!destfp) {
-      printf("Can't open %s\n", filename);
-      closedir(dp);
+    if (!strcmp(linebuf, ".\r\n"))
+      break;
+    num = parse_overview(linebuf, &hdrs);
+    if ((num < first) || (num > last) || (numwanted == OVERCHUNK))
+      continue;
+    if (newsrc_has(&fetched, num))
+      continue;
+    if (is_on_killlist(hdrs.from, hdrs.subject, hdrs.cc)) {
+      printf("** Article %lu from %s - KILLED!\n", num, hdrs.from);
+      continue;
+    }
+    wanted[numwanted++] = num;
+    fwrite(&hdrs, sizeof(struct emailhdrs), 1, ovfp);
+  }
+  fclose(ovfp);
+  printf(" %u of %lu articles wanted\n", numwanted, last - first + 1);
+  return 0;
+}
+
+/*
+ * Get the From headers of articles first..last and decide which to fetch
+ * Used when the server does not support XOVER. HDR (RFC 3977) is tried
+ * first, then XHDR. Articles whose From is on the kill-list are dropped
+ * here, before they are downloaded. Subject and Message-ID patterns are
+ * applied later, when the article is copied to the mailbox.
+ * Returns 1 if the server supports neither command, 2 if it refused the
+ * command for some other reason, 0 otherwise
+ */
+uint8_t get_hdr_from(uint32_t first, uint32_t last) {
+  static char sendbuf[40];
+  static char from[80];
+  uint32_t num;
+  char *p;
+  numwanted = 0;
+  while (1) {
+    sprintf(sendbuf, "%s From %lu-%lu\r\n", hdrcmd, first, last);
+    if (!w5100_tcp_send_recv(sendbuf, buf, NETBUFSZ, DO_SEND)) {
       error_exit();
     }
-    onkilllist = 0;
-    headers = 1;
-    headerchars = 0;
-    hdrs.skipbytes = 0; // Just in case it doesn't get set
-    hdrs.status = 'N';
-    hdrs.tag = ' ';
-    hdrs.date[0] = hdrs.from[0] = hdrs.cc[0] = hdrs.subject[0] = '\0';
-    // Store News:newsgroup in TO field
-    strcpy(linebuf, "News:");
-    strcat(linebuf, newsgroup);
-    copyheader(hdrs.to, linebuf, 79);
-    while ((chars = get_line(fp, linebuf, LINEBUFSZ)) != 0) {
-      if (headers) {
-        headerchars += chars;
-        if (!strncmp(linebuf, "Date: ", 6)) {
-          copyheader(hdrs.date, linebuf + 6, 39);
-          hdrs.date[39] = '\0';
+    if (!strncmp(buf, "420", 3) || !strncmp(buf, "423", 3))
+      return 0; // No articles in range
+    if (buf[0] == '2') // "225" for HDR, "221" for XHDR
+      break;
+    if (strncmp(buf, "500", 3) && strncmp(buf, "501", 3))
+      return 2;
+    if (hdrcmd[0] == 'X')
+      return 1;
+    hdrcmd = "XHDR";
+  }
+  while (1) {
+    if (!w5100_get_line(linebuf, LINEBUFSZ)) {
+      error_exit();
+    }
+    if (!strcmp(linebuf, ".\r\n"))
+      break;
+    num = atol(linebuf);
+    p = strchr(linebuf, ' ');
+    if (!p || (num < first) || (num > last) || (numwanted == OVERCHUNK))
+      continue;
+    if (newsrc_has(&fetched, num))
+      continue;
+    decode_header(from, p + 1, 80);
+    if (is_on_killlist(from, "", NULL)) {
+      printf("** Article %lu from %s - KILLED!\n", num, from);
+      continue;
+    }
+    wanted[numwanted++] = num;
+  }
+  printf(" %u of %lu articles wanted\n", numwanted, last - first + 1);
+  return 0;
+}
+
+/*
+ * Receive one article from the server straight into the mailbox
+ * The article is read a line at a time. CRLF is converted to the Apple II
+ * (CR) convention, dot-stuffing is undone and the header is parsed as it
+ * arrives. The Organization header is stored in the CC field and skipbytes
+ * is set. If the article is on the kill-list, the rest of it is read and
+ * thrown away, and EMAIL.n is deleted.
+ * mbox  - mailbox to write to
+ * h     - headers for EMAIL.DB. h->emailnum is the number of EMAIL.n.
+ * parse - if 1, also find Date, From and Subject and apply the kill-list
+ * Returns 1 if the article was killed, 0 otherwise
+ */
+uint8_t receive_article(char *mbox, struct emailhdrs *h, uint8_t parse) {
+  static char msgid[80];
+  uint16_t chars, headerchars;
+  uint8_t headers, onkilllist, lines;
+  char *lasthdr, *p;
+  FILE *destfp;
+  sprintf(filename, "%s/%s/EMAIL.%u", cfg_emaildir, mbox, h->emailnum);
+  _filetype = PRODOS_T_TXT;
+  _auxtype = 0;
+  destfp = fopen(filename, "wb");
+  if (!destfp) {
+    printf("Can't open %s\n", filename);
+    error_exit();
+  }
+  onkilllist = 0;
+  headers = 1;
+  headerchars = 0;
+  lines = 0;
+  lasthdr = NULL;
+  filesize = 0;
+  h->skipbytes = 0; // Just in case it doesn't get set
+  memset(h->cc, 0, sizeof(h->cc));
+  msgid[0] = '\0';
+  while (1) {
+    // One byte short of linebuf[] to leave room for the CR below
+    if (!w5100_get_line(linebuf, LINEBUFSZ - 1)) {
+      error_exit();
+    }
+    if (!strcmp(linebuf, ".\r\n"))
+      break;
+    p = (linebuf[0] == '.' ? linebuf + 1 : linebuf);
+    chars = strlen(p);
+    if (chars && (p[chars - 1] == '\n'))
+      --chars;
+    if (!chars || (p[chars - 1] != '\r')) // Bare LF or truncated line
+      p[chars++] = '\r';
+    p[chars] = '\0';
+    filesize += chars;
+    if (!(++lines & 0x1f))
+      spinner(filesize, 0);
+    if (onkilllist)
+      continue;
+    if (headers) {
+      headerchars += chars;
+      if (parse) {
+        if ((p[0] == ' ') || (p[0] == '\t')) {
+          if (lasthdr) // Folded From or Subject
+            decode_header(lasthdr, p, 80);
+        } else
+          lasthdr = NULL;
+        if (!strncmp(p, "Date: ", 6)) {
+          copyheader(h->date, p + 6, 39);
+          h->date[39] = '\0';
         }
-        if (!strncmp(linebuf, "From: ", 6)) {
-          copyheader(hdrs.from, linebuf + 6, 79);
-          hdrs.from[79] = '\0';
-          if (sender_is_on_killlist(hdrs.from)) {
-            fputs(" - KILLED!", stdout);
-            onkilllist = 1;
-            break;
-          }
+        if (!strncmp(p, "From: ", 6)) {
+          decode_header(h->from, p + 6, 80);
+          lasthdr = h->from;
         }
-        // Store Organization in CC field
-        if (!strncmp(linebuf, "Organization: ", 14)) {
-          copyheader(hdrs.cc, linebuf + 14, 79);
-          hdrs.cc[79] = '\0';
+        if (!strncmp(p, "Subject: ", 9)) {
+          decode_header(h->subject, p + 9, 80);
+          lasthdr = h->subject;
         }
-        if (!strncmp(linebuf, "Subject: ", 9)) {
-          copyheader(hdrs.subject, linebuf + 9, 79);
-          hdrs.subject[79] = '\0';
+        if (!strncmp(p, "Message-ID: ", 12)) {
+          copyheader(msgid, p + 12, 79);
+          msgid[79] = '\0';
         }
-        if (linebuf[0] == '\r') {
-          headers = 0;
-          hdrs.skipbytes = headerchars;
+      }
+      // Store Organization in CC field
+      if (!strncmp(p, "Organization: ", 14)) {
+        copyheader(h->cc, p + 14, 79);
+        h->cc[79] = '\0';
+      }
+      if (p[0] == '\r') {
+        headers = 0;
+        h->skipbytes = headerchars;
+        if (parse && is_on_killlist(h->from, h->subject, msgid)) {
+          onkilllist = 1;
+          continue;
         }
       }
-      fputs(linebuf, destfp);
     }
-    fclose(fp);
-    fclose(destfp);
-    if (onkilllist == 1)
-      unlink(filename);
-    else
+    if (fputs(p, destfp) == EOF) {
+      printf("Write error");
+      error_exit();
+    }
+  }
+  spinner(filesize, 1); // Cleanup spinner
+  fclose(destfp);
+  if (onkilllist) {
+    printf("** Article from %s - KILLED!\n", h->from);
+    unlink(filename);
+  }
+  return onkilllist;
+}
+
+/*
+ * Download the articles in wanted[] straight into the mailbox
+ * Up to window ARTICLE requests are sent ahead, without waiting for the
+ * responses. The responses come back in order, and are read one at a time
+ * as they arrive.
+ * If XOVER was used, the headers for EMAIL.DB come from OVERVIEW.DB,
+ * otherwise the headers of interest (Date, From, Subject) are found as the
+ * article arrives and the kill-list is applied.
+ * Each article which is stored, killed or no longer on the server is added
+ * to fetched. If the server refuses an ARTICLE command for any other
+ * reason, no more are sent and only the replies to those already sent are
+ * read.
+ * mbox     - mailbox to write to
+ * highnum  - highest article number in the group, for progress display
+ * msgcount - incremented for each article added to the mailbox
+ * Returns 1 if the server refused an article, 0 otherwise
+ */
+uint8_t fetch_articles(char *mbox, uint32_t highnum, uint16_t *msgcount) {
+  static struct emailhdrs hdrs;
+  static char sendbuf[30];
+  uint8_t i, sent = 0, stopped = 0;
+  FILE *ovfp = NULL;
+  if (have_over) {
+    sprintf(filename, "%s/NEWS.SPOOL/OVERVIEW.DB", cfg_emaildir);
+    ovfp = fopen(filename, "rb");
+  }
+  for (i = 0; i < numwanted; ++i) {
+    if (stopped && (i == sent))
+      break;
+    while (!stopped && (sent < numwanted) && (sent - i < window)) {
+      sprintf(sendbuf, "ARTICLE %lu\r\n", wanted[sent++]);
+      putchar('>');
+      print_strip_crlf(sendbuf);
+      if (!w5100_send_text(sendbuf)) {
+        error_exit();
+      }
+    }
+    printf("\n** Retrieving article %lu/%lu from %s\n", wanted[i], highnum, newsgroup);
+    if (!w5100_tcp_send_recv(sendbuf, buf, NETBUFSZ, DONT_SEND)) {
+      error_exit();
+    }
+    if (ovfp)
+      fread(&hdrs, sizeof(struct emailhdrs), 1, ovfp);
+    if (!strncmp(buf, "423", 3) || !strncmp(buf, "430", 3)) {
+      // Cancelled or expired
+      newsrc_add(&fetched, wanted[i], wanted[i]);
+      continue;
+    }
+    if (strncmp(buf, "220", 3)) {
+      stopped = 1;
+      continue;
+    }
+    if (!ovfp) {
+      memset(&hdrs, 0, sizeof(hdrs));
+      hdrs.emailnum = wanted[i];
+      hdrs.status = 'N';
+      hdrs.tag = ' ';
+      // Store News:newsgroup in TO field
+      strcpy(linebuf, "News:");
+      strcat(linebuf, newsgroup);
+      copyheader(hdrs.to, linebuf, 79);
+    }
+    if (!receive_article(mbox, &hdrs, !ovfp)) {
       update_email_db(mbox, &hdrs);
-    puts("");
+      ++*msgcount;
+    }
+    newsrc_add(&fetched, wanted[i], wanted[i]);
+  }
+  if (ovfp) {
+    fclose(ovfp);
+    sprintf(filename, "%s/NEWS.SPOOL/OVERVIEW.DB", cfg_emaildir);
+    unlink(filename);
+  }
+  return stopped;
+}
+
+/*
+ * Update mailbox of a header-only newsgroup
+ * Only the EMAIL.DB records are written, straight from OVERVIEW.DB, and
+ * no EMAIL.n files are created. The Message-ID is kept in the CC field,
+ * so that EMAIL.SYSTEM can have the article fetched when it is opened.
+ * Returns number of articles added
+ */
+uint8_t overview_to_mailbox(char *mbox) {
+  static struct emailhdrs hdrs;
+  uint8_t count = 0;
+  FILE *ovfp, *dbfp;
+  sprintf(filename, "%s/NEWS.SPOOL/OVERVIEW.DB", cfg_emaildir);
+  ovfp = fopen(filename, "rb");
+  if (!ovfp)
+    return 0;
+  sprintf(linebuf, "%s/%s/EMAIL.DB", cfg_emaildir, mbox);
+  _filetype = PRODOS_T_BIN;
+  _auxtype = 0;
+  dbfp = fopen(linebuf, "ab");
+  if (!dbfp) {
+    printf("Can't open %s\n", linebuf);
+    error_exit();
+  }
+  while (fread(&hdrs, sizeof(struct emailhdrs), 1, ovfp) == 1) {
+    fwrite(&hdrs, sizeof(struct emailhdrs), 1, dbfp);
+    ++count;
+  }
+  fclose(dbfp);
+  fclose(ovfp);
+  unlink(filename);
+  return count;
+}
 
-    //sprintf(filename, "%s/NEWS.SPOOL/NEWS.%u", cfg_emaildir, msg);
-    sprintf(filename, "%s/NEWS.SPOOL/%s", cfg_emaildir, d->d_name);
-    if (unlink(filename))
-      printf("Can't delete %s\n", filename);
+/*
+ * Fetch the article for an entry in a header-only newsgroup
+ * Called when EMAIL.SYSTEM runs NNTP65 with GET <mailbox> <num>.
+ * The article is requested by the Message-ID held in the CC field of the
+ * EMAIL.DB record, then EMAIL.n is written and the record updated.
+ */
+void get_article(char *mbox, uint16_t num) {
+  static struct emailhdrs hdrs;
+  static char sendbuf[100];
+  uint16_t idx = 0;
+  FILE *dbfp;
+  char *p;
+  sprintf(linebuf, "%s/%s/EMAIL.DB", cfg_emaildir, mbox);
+  dbfp = fopen(linebuf, "rb+");
+  if (!dbfp) {
+    printf("Can't open %s\n", linebuf);
+    error_exit();
+  }
+  while (1) {
+    if (fread(&hdrs, sizeof(struct emailhdrs), 1, dbfp) != 1) {
+      printf("No article %u in %s\n", num, mbox);
+      fclose(dbfp);
+      error_exit();
+    }
+    if ((hdrs.emailnum == num) && (hdrs.cc[0] == '<'))
+      break;
+    ++idx;
+  }
+  p = strchr(hdrs.cc, ' ');
+  if (p)
+    *p = '\0';
+  printf("\n** Retrieving article %s\n", hdrs.cc);
+  sprintf(sendbuf, "ARTICLE %s\r\n", hdrs.cc);
+  if (!w5100_tcp_send_recv(sendbuf, buf, NETBUFSZ, DO_SEND)) {
+    error_exit();
+  }
+  if (expect(buf, "220")) {
+    fclose(dbfp);
+    error_exit();
   }
-  closedir(dp);
+  receive_article(mbox, &hdrs, 0);
+  fseek(dbfp, (uint32_t)idx * sizeof(struct emailhdrs), SEEK_SET);
+  fwrite(&hdrs, sizeof(struct emailhdrs), 1, dbfp);
+  fclose(dbfp);
 }
 
 void main(int argc, char *argv[]) {
-  uint32_t nummsgs, lownum, highnum, msgnum, msg;
+  uint32_t nummsgs, lownum, highnum, msgnum, msg, first, last;
   uint16_t msgcount, i;
   char sendbuf[80];
   FILE *logfp;
-  uint8_t eth_init = ETH_INIT_DEFAULT;
-
-  if ((argc == 2) && (strcmp(argv[1], "EMAIL") == 0))
-    exec_email_on_exit = 1;
-
-  linebuf_pad[0] = 0;
+  uint8_t eth_init = ETH_INIT_DEFAULT, hdronly, err;
+  static char flags[8];
+
+  // EMAIL - return to EMAIL.SYSTEM on exit
+  // SYNC  - run the next program of a SYNC65 run on exit
+  // GET mailbox n - fetch article n of a header-only newsgroup
+  for (i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "EMAIL") == 0)
+      exec_email_on_exit = 1;
+    else if (strcmp(argv[i], "SYNC") == 0)
+      chained = 1;
+    else if ((strcmp(argv[i], "GET") == 0) && (i + 2 < argc)) {
+      getmbox = argv[++i];
+      getnum = atoi(argv[++i]);
+    }
+  }
 
   videomode(VIDEOMODE_80COL);
   printf("%c%s NNTP - Receive News Articles%c\n", 0x0f, PROGNAME, 0x0e);
@@ -594,27 +866,30 @@ void main(int argc, char *argv[]) {
   else
     printf(" None");
   
-  printf("\nReading NEWSGROUPS.CFG       - ");
-  sprintf(filename, "%s/NEWSGROUPS.CFG", cfg_emaildir);
-  newsgroupsfp = fopen(filename, "r");
-  if (!newsgroupsfp) {
-    printf("\nCan't read %s\n", filename);
-    error_exit();
-  }
+  if (!getmbox) {
+    printf("\nReading NEWSGROUPS.CFG       - ");
+    sprintf(filename, "%s/NEWSGROUPS.CFG", cfg_emaildir);
+    newsgroupsfp = fopen(filename, "r");
+    if (!newsgroupsfp) {
+      printf("\nCan't read %s\n", filename);
+      error_exit();
+    }
 
-  printf("Ok\nCreating NEWSGROUPS.NEW      - ");
-  sprintf(filename, "%s/NEWSGROUPS.NEW", cfg_emaildir);
-  _filetype = PRODOS_T_TXT;
-  _auxtype = 0;
-  newnewsgroupsfp = fopen(filename, "wb");
-  if (!newnewsgroupsfp) {
-    printf("\nCan't open %s\n", filename);
-    error_exit();
+    printf("Ok\nCreating NEWSGROUPS.NEW      - ");
+    sprintf(filename, "%s/NEWSGROUPS.NEW", cfg_emaildir);
+    _filetype = PRODOS_T_TXT;
+    _auxtype = 0;
+    newnewsgroupsfp = fopen(filename, "wb");
+    if (!newnewsgroupsfp) {
+      printf("\nCan't open %s\n", filename);
+      error_exit();
+    }
+    printf("Ok");
   }
 
   {
     int file;
-    printf("Ok\nSetting slot                 - ");
+    printf("\nSetting slot                 - ");
     file = open("ethernet.slot", O_RDONLY);
     if (file != -1) {
       read(file, &eth_init, 1);
@@ -623,17 +898,21 @@ void main(int argc, char *argv[]) {
     }
   }
 
-  printf("%d\nInitializing %s     - ", eth_init, eth_name);
-  if (ip65_init(eth_init)) {
-    ip65_error_exit();
-  }
-
   // Abort on Ctrl-C to be consistent with Linenoise
   abort_key = 0x83;
 
-  printf("Ok\nObtaining IP address         - ");
-  if (dhcp_init()) {
-    ip65_error_exit();
+  if (chained && chain_net_load(&eth_init)) {
+    printf("%d\nUsing network from SYNC65    - ", eth_init);
+  } else {
+    printf("%d\nInitializing %s     - ", eth_init, eth_name);
+    if (ip65_init(eth_init)) {
+      ip65_error_exit();
+    }
+
+    printf("Ok\nObtaining IP address         - ");
+    if (dhcp_init()) {
+      ip65_error_exit();
+    }
   }
 
   // Copy IP config from IP65 to W5100
@@ -649,7 +928,7 @@ void main(int argc, char *argv[]) {
 
   printf("Ok\n\n");
 
-  if (!w5100_tcp_send_recv(sendbuf, buf, NETBUFSZ, DONT_SEND, CMD_MODE)) {
+  if (!w5100_tcp_send_recv(sendbuf, buf, NETBUFSZ, DONT_SEND)) {
     error_exit();
   }
   if (expect(buf, "20")) // "200" if posting is allowed / "201" if no posting
@@ -658,40 +937,51 @@ void main(int argc, char *argv[]) {
   // Skip authentication?
   if (strcmp(cfg_user, "-") != 0) {
     sprintf(sendbuf, "AUTHINFO USER %s\r\n", cfg_user);
-    if (!w5100_tcp_send_recv(sendbuf, buf, NETBUFSZ, DO_SEND, CMD_MODE)) {
+    if (!w5100_tcp_send_recv(sendbuf, buf, NETBUFSZ, DO_SEND)) {
       error_exit();
     }
     if (expect(buf, "381")) // Username accepted
       error_exit();
 
     sprintf(sendbuf, "AUTHINFO PASS %s\r\n", cfg_pass);
-    if (!w5100_tcp_send_recv(sendbuf, buf, NETBUFSZ, DO_SEND, CMD_MODE)) {
+    if (!w5100_tcp_send_recv(sendbuf, buf, NETBUFSZ, DO_SEND)) {
       error_exit();
     }
     if (expect(buf, "281")) // Authentication successful
       error_exit();
   }
 
+  if (getmbox) {
+    get_article(getmbox, getnum);
+    goto quit;
+  }
+
   // Make empty log file
   _filetype = PRODOS_T_TXT;
   _auxtype = 0;
   logfp = fopen(LOGFILE, "w");
   fclose(logfp);
 
-  while (1) {
-    msg = fscanf(newsgroupsfp, "%s %s %ld", newsgroup, mailbox, &msgnum);
-    if (strcmp(newsgroup, "0") == 0)
-      break;
+  // Each line is: newsgroup mailbox lastmsg [H]
+  // H means header-only - only the overview is stored in the mailbox
+  while (read_text_line(newsgroupsfp, linebuf, LINEBUFSZ)) {
+    flags[0] = '\0';
+    msg = sscanf(linebuf, "%s %s %ld %7s", newsgroup, mailbox, &msgnum, flags);
     if ((msg == 0) || (msg == EOF))
+      continue;
+    if (strcmp(newsgroup, "0") == 0)
       break;
+    if (msg < 3)
+      continue;
+    hdronly = (flags[0] == 'H');
     printf("*************************************************************\n");
     printf("* NEWSGROUP: %s\n", newsgroup);
     printf("* MAILBOX:   %s\n", mailbox);
-    printf("* START MSG: %ld\n", msgnum);
+    printf("* START MSG: %ld%s\n", msgnum, (hdronly ? " (HEADERS ONLY)" : ""));
     printf("*************************************************************\n");
 
     sprintf(sendbuf, "GROUP %s\r\n", newsgroup);
-    if (!w5100_tcp_send_recv(sendbuf, buf, NETBUFSZ, DO_SEND, CMD_MODE)) {
+    if (!w5100_tcp_send_recv(sendbuf, buf, NETBUFSZ, DO_SEND)) {
       error_exit();
     }
     if (strncmp(buf, "411", 3) == 0) {
@@ -703,49 +993,81 @@ void main(int argc, char *argv[]) {
     sscanf(buf, "211 %lu %lu %lu", &nummsgs, &lownum, &highnum);
     printf(" Approx. %lu messages, numbered from %lu to %lu\n", nummsgs, lownum, highnum);
 
-    if (msgnum == 0)
-      msgnum = highnum - 100; // If 0 is specified grab 100 messages to start
+    if (msgnum == 0) // If 0 is specified grab 100 messages to start
+      msgnum = (highnum > 100 ? highnum - 100 : 0);
 
-    if (msgnum < lownum)
-      msgnum = lownum;
+    if (msgnum + 1 < lownum)
+      msgnum = lownum - 1;
 
-    for (msg = msgnum; msg <= highnum; ++msg) {
-      sprintf(sendbuf, "STAT %ld\r\n", msgnum);
-      if (!w5100_tcp_send_recv(sendbuf, buf, NETBUFSZ, DO_SEND, CMD_MODE)) {
-        error_exit();
-      }
-      if (strncmp(buf, "220", 3)) // Message number exists
-        break;
-    }
+    sprintf(fetchedname, "%s/%s/" NEWSRC_FETCHED, cfg_emaildir, mailbox);
+    newsrc_load(fetchedname, &fetched);
 
+    // Work through the group OVERCHUNK articles at a time. Articles are
+    // requested by number, so there is no STAT or NEXT round trip.
+    msg = msgnum;
     msgcount = 0;
-    while (1) {
-      if (!w5100_tcp_send_recv("NEXT\r\n", buf, NETBUFSZ, DO_SEND, CMD_MODE)) {
-        error_exit();
+    for (first = msgnum + 1; first <= highnum; first = last + 1) {
+      last = first + OVERCHUNK - 1;
+      if (last > highnum)
+        last = highnum;
+      if (newsrc_covers(&fetched, first, last)) {
+        printf("** Articles %lu-%lu already fetched\n", first, last);
+        msg = last;
+        continue;
       }
-      if (strncmp(buf, "223", 3) != 0)
-        break; // No more messages in group
-      sscanf(buf, "223 %ld", &msg);
-      sprintf(filename, "%s/NEWS.SPOOL/NEWS.%lu", cfg_emaildir, msg);
-      _filetype = PRODOS_T_TXT;
-      _auxtype = 0;
-      fp = fopen(filename, "wb"); 
-      if (!fp) {
-        printf("Can't create %s\n", filename);
-        error_exit();
+      if (have_over) {
+        err = get_overview(first, last);
+        if (err == 2) {
+          // Leave the rest of this group for next time
+          printf("** XOVER failed, skipping rest of %s\n", newsgroup);
+          break;
+        }
+        if (err) {
+          printf("** Server does not support XOVER\n");
+          have_over = 0;
+        }
       }
-      printf("\n** Retrieving article %lu/%lu from %s\n", msg, highnum, newsgroup);
-      if (!w5100_tcp_send_recv("ARTICLE\r\n", buf, NETBUFSZ, DO_SEND, DATA_MODE)) {
-        error_exit();
+      if (!have_over && have_hdr) {
+        err = get_hdr_from(first, last);
+        if (err == 2) {
+          printf("** %s failed, skipping rest of %s\n", hdrcmd, newsgroup);
+          break;
+        }
+        if (err) {
+          printf("** Server does not support HDR or XHDR\n");
+          have_hdr = 0;
+        }
+      }
+      if (!have_over && !have_hdr) {
+        numwanted = 0;
+        for (msg = first; msg <= last; ++msg)
+          if (!newsrc_has(&fetched, msg))
+            wanted[numwanted++] = msg;
+      }
+      printf("Updating mailbox %s ...\n", mailbox);
+      err = 0;
+      if (hdronly && have_over)
+        msgcount += overview_to_mailbox(mailbox);
+      else {
+        err = fetch_articles(mailbox, highnum, &msgcount);
+      }
+      // Unless the server refused an article, every article in the chunk
+      // has now been fetched, killed or found to be missing, so none of
+      // them need to be looked at again
+      if (!err)
+        newsrc_add(&fetched, first, last);
+      if (newsrc_save(fetchedname, &fetched))
+        printf("Can't write %s\n", fetchedname);
+      if (err) {
+        // Leave the rest of this group for next time
+        printf("** ARTICLE failed, skipping rest of %s\n", newsgroup);
+        break;
       }
-      spinner(filesize, 1); // Cleanup spinner
-      fclose(fp);
-      ++msgcount;
+      msg = last;
     }
     printf("Updating NEWSGROUPS.NEW (%s:%ld) ...\n", newsgroup, msg);
-    fprintf(newnewsgroupsfp, "%s %s %ld\n", newsgroup, mailbox, msg);
-    printf("Updating mailbox %s ...\n", mailbox);
-    update_mailbox(mailbox);
+    fprintf(newnewsgroupsfp, "%s %s %ld%s\n", newsgroup, mailbox, msg,
+            (hdronly ? " H" : ""));
 
     _filetype = PRODOS_T_TXT;
     _auxtype = 0;
@@ -773,14 +1095,15 @@ void main(int argc, char *argv[]) {
     error_exit();
   }
 
+quit:
   // Ignore any error - can be a race condition where other side
   // disconnects too fast and we get an error
-  w5100_tcp_send_recv("QUIT\r\n", buf, NETBUFSZ, DO_SEND, CMD_MODE);
+  w5100_tcp_send_recv("QUIT\r\n", buf, NETBUFSZ, DO_SEND);
 
   printf("Disconnecting\n");
   w5100_disconnect();
 
-  logfp = fopen(LOGFILE, "r");
+  logfp = (getmbox ? NULL : fopen(LOGFILE, "r"));
   if (logfp) {
     puts("\nNNTP65 Session Summary:\n");
     i = fgetc(logfp);
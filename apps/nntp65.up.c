@@ -22,6 +22,9 @@
 #include "w5100.h"
 
 #include "email_common.h"
+#include "chain.h"
+#include "netio.h"
+#include "sentcopy.h"
 
 #define BELL      7
 #define BACKSPACE 8
@@ -42,18 +45,48 @@ static unsigned char buf[NETBUFSZ+1];    // One extra byte for null terminator
 static char          linebuf[LINEBUFSZ];
 
 uint8_t  exec_email_on_exit = 0;
+uint8_t  chained = 0;     // 1 if run as part of SYNC65
 char     filename[80];
 int      len;
 FILE     *fp;
+uint16_t nextemail;       // Number of next NEWS.SENT/EMAIL.n
+static struct emailhdrs hdrs; // Headers of message being sent
 uint32_t filesize;
 uint16_t nntp_port;
+uint8_t  batch = 0;       // 1 if running without user interaction
+uint8_t  sendall = 0;     // 1 to send all messages without asking
+uint8_t  streaming = 0;   // 1 if server accepted MODE STREAM
+char     msgid[100];      // Message-ID of message being sent
+uint8_t  needpath;        // 1 if message being sent has no Path header
+
+#define STREAMWIN 4       // Max TAKETHIS articles sent ahead of replies
+
+/*
+ * Article sent with TAKETHIS which is waiting for its reply
+ */
+struct streament {
+  char             name[16];  // File name in NEWS.OUTBOX
+  struct emailhdrs hdrs;      // NEWS.SENT headers, saved once accepted
+};
+static struct streament window[STREAMWIN];
+uint8_t  winfirst = 0;    // Oldest entry in window[]
+uint8_t  waiting = 0;     // Number of entries in window[]
+
+#define REFUSEDMAX 16     // Max articles refused by TAKETHIS to POST later
+
+static char refused[REFUSEDMAX][16]; // File names in NEWS.OUTBOX
+uint8_t  nrefused = 0;    // Number of entries in refused[]
 
 /*
  * Keypress before quit
  */
 void confirm_exit(void) {
-  printf("\n[Press Any Key]");
-  cgetc();
+  if (chained)
+    chain_exec(cfg_instdir, CHAIN_END, exec_email_on_exit);
+  if (!batch) {
+    printf("\n[Press Any Key]");
+    cgetc();
+  }
   if (exec_email_on_exit) {
     sprintf(filename, "%s/EMAIL.SYSTEM", cfg_instdir);
     exec(filename, NULL);
@@ -150,8 +183,34 @@ done:
 #define CMD_MODE  0  // For mode param
 #define DATA_MODE 1  // For mode param
 
+// Send the message body from file fp as DATA, followed by the terminating
+// "." line.
+// The file is read in blocks of READSZ bytes into buf[] and each block is
+// sent by w5100_send_crlf() with dot-stuffing, as required by RFC 3977.
+bool w5100_send_body(void) {
+  uint16_t end;
+
+  filesize = 0;
+  w5100_crlf_start();
+  fseek(fp, 0, SEEK_SET);
+
+  while ((end = fread(buf, 1, READSZ, fp)) != 0) {
+    if (sent_write((char*)buf, end))
+      error_exit();
+    filesize += end;
+    spinner(filesize, 0);
+    if (!w5100_send_crlf((char*)buf, end, 1))
+      return false;
+  }
+  spinner(filesize, 1);
+
+  return w5100_send_dot();
+}
+
 // Modified verson of w5100_http_open from w5100_http.c
-// Sends a TCP message and receives a the first packet of the response.
+// Sends a TCP message and receives the response.
+// Only the response itself is taken from the W5100, so the replies to
+// streamed articles are left to be read one at a time.
 // sendbuf is the buffer to send (null terminated)
 // recvbuf is the buffer into which the received message will be written
 // length is the length of recvbuf[]
@@ -166,174 +225,30 @@ bool w5100_tcp_send_recv(char* sendbuf, char* recvbuf, size_t length,
       //
       // Handle sending of email body
       //
-      uint16_t pos = 0;
-      uint8_t  cont = 1;
-      uint16_t snd;
-      int16_t len;
-
-      filesize = 0;
-      len = get_line(fp, 1, linebuf, LINEBUFSZ); // Reset buffer
-
-      while (cont) { 
-
-        len = get_line(fp, 0, linebuf, LINEBUFSZ - 1);
-        pos = 0;
-
-        if (len == 0) {
-          strcpy(linebuf, "\r\n.\r\n");
-          len = 5;
-          cont = 0;
-        } else {
-          linebuf[len++] = '\n'; // CR -> CRLF
-          linebuf[len] = '\0';
-          filesize += len;
-        }
-
-        while (len) {
-          if (input_check_for_abort_key())
-          {
-            printf("User abort\n");
-            w5100_disconnect();
-            return false;
-          }
-
-          snd = w5100_send_request();
-          if (!snd) {
-            if (!w5100_connected()) {
-              printf("Connection lost\n");
-              return false;
-            }
-            continue;
-          }
-
-          if (len < snd)
-            snd = len;
-
-          {
-            // One less to allow for faster pre-increment below
-            const char *dataptr = linebuf + pos - 1;
-            uint16_t i;
-            for (i = 0; i < snd; ++i) {
-              // The variable is necessary to have cc65 generate code
-              // suitable to access the W5100 auto-increment register.
-              char data = *++dataptr;
-              *w5100_data = data;
-            }
-          }
-
-          w5100_send_commit(snd);
-          len -= snd;
-          pos += snd;
-        }
-        spinner(filesize, 0);
-      }
-      spinner(filesize, 1);
+      if (!w5100_send_body())
+        return false;
 
     } else {
       //
       // Handle short ASCII text transmissions
       //
-      uint16_t snd;
-      uint16_t pos = 0;
-      uint16_t len = strlen(sendbuf);
-
       if (strncmp(sendbuf, "AUTHINFO PASS", 13) == 0)
         printf(">AUTHINFO PASS ****\n");
       else {
         putchar('>');
         print_strip_crlf(sendbuf);
       }
-
-      while (len) {
-        if (input_check_for_abort_key())
-        {
-          printf("User abort\n");
-          w5100_disconnect();
-          return false;
-        }
-
-        snd = w5100_send_request();
-        if (!snd) {
-          if (!w5100_connected()) {
-            printf("Connection lost\n");
-            return false;
-          }
-          continue;
-        }
-
-        if (len < snd)
-          snd = len;
-
-        {
-          // One less to allow for faster pre-increment below
-          const char *dataptr = sendbuf + pos - 1;
-          uint16_t i;
-          for (i = 0; i < snd; ++i) {
-            // The variable is necessary to have cc65 generate code
-            // suitable to access the W5100 auto-increment register.
-            char data = *++dataptr;
-            *w5100_data = data;
-          }
-        }
-
-        w5100_send_commit(snd);
-        len -= snd;
-        pos += snd;
-      }
-    }
-  }
-
-  {
-    //
-    // Handle short single packet ASCII text responses
-    // Must fit in recvbuf[]
-    //
-    uint16_t rcv;
-    uint16_t len = 0;
-    uint8_t cont = 1;
-
-    --length; // Leave space for NULL at end in case of buffer overrun
-
-    while (cont) {
-      if (input_check_for_abort_key()) {
-        printf("User abort\n");
-        w5100_disconnect();
+      if (!w5100_send_text(sendbuf))
         return false;
-      }
-    
-      rcv = w5100_receive_request();
-      if (!rcv) {
-        cont = w5100_connected();
-        if (cont)
-          continue;
-      }
-
-      if ((length - len) == 0)
-        cont = 0;
-
-      if (rcv > length - len)
-        rcv = length - len;
-
-      {
-        // One less to allow for faster pre-increment below
-        char *dataptr = recvbuf + len - 1;
-        uint16_t i;
-        for (i = 0; i < rcv; ++i) {
-          // The variable is necessary to have cc65 generate code
-          // suitable to access the W5100 auto-increment register.
-          char data = *w5100_data;
-          *++dataptr = data;
-          if (!memcmp(dataptr - 1, "\r\n", 2))
-            cont = 0;
-        }
-      }
-      w5100_receive_commit(rcv);
-      len += rcv;
     }
-    recvbuf[len + 1] = '\0';
-    putchar('<');
-    print_strip_crlf(recvbuf);
   }
+
+  // Handle short single line ASCII text responses
+  // Must fit in recvbuf[]
+  if (!w5100_get_line(recvbuf, length))
+    return false;
+  putchar('<');
+  print_strip_crlf(recvbuf);
   return true;
 }
 
@@ -408,6 +323,7 @@ void copyheader(char *dest, char *source, uint16_t len) {
  * Write NEXT.EMAIL file with number of next EMAIL.n file to be created
  */
 void write_next_email(uint16_t num) {
+  FILE *fp;
   sprintf(filename, "%s/NEWS.SENT/NEXT.EMAIL", cfg_emaildir);
   _filetype = PRODOS_T_TXT;
   _auxtype = 0;
@@ -422,16 +338,10 @@ void write_next_email(uint16_t num) {
 }
 
 /*
- * Update NEWS.SENT when a message has been sent
- * Copy a messages from OUTBOX to SENT and find headers of interest
- * (Date, From, To, BCC, Subject)
- * filename - Filename in OUTBOX for message just sent
+ * Read NEWS.SENT/NEXT.EMAIL once at start up
  */
-void update_sent_mbox(char *name) {
-  static struct emailhdrs hdrs;
-  uint16_t nextemail, chars, headerchars;
-  uint8_t headers;
-  FILE *destfp;
+void read_next_email(void) {
+  FILE *fp;
   sprintf(filename, "%s/NEWS.SENT/NEXT.EMAIL", cfg_emaildir);
   fp = fopen(filename, "r");
   if (!fp) {
@@ -441,78 +351,218 @@ void update_sent_mbox(char *name) {
     fscanf(fp, "%u", &nextemail);
     fclose(fp);
   }
-  strcpy(linebuf, "");
-  sprintf(filename, "%s/NEWS.OUTBOX/%s", cfg_emaildir, name);
-  fp = fopen(filename, "r");
-  if (!fp) {
-    printf("Can't open %s\n", filename);
-    error_exit();
+}
+
+/*
+ * Record a header of interest (Date, From, Newsgroups, Organization, Subject)
+ * Called by sent_write() for each header line of the NEWS.SENT copy
+ * line - header line, ending in CR
+ */
+void sent_header(char *line) {
+  if (!strncmp(line, "Date: ", 6)) {
+    copyheader(hdrs.date, line + 6, 39);
+    hdrs.date[39] = '\0';
   }
-  hdrs.emailnum = nextemail;
-  sprintf(filename, "%s/NEWS.SENT/EMAIL.%u", cfg_emaildir, nextemail++);
-  puts(filename);
-  _filetype = PRODOS_T_TXT;
-  _auxtype = 0;
-  destfp = fopen(filename, "wb");
-  if (!destfp) {
-    printf("Can't open %s\n", filename);
-    fclose(fp);
-    error_exit();
+  if (!strncmp(line, "From: ", 6)) {
+    copyheader(hdrs.from, line + 6, 79);
+    hdrs.from[79] = '\0';
+  }
+  if (!strncmp(line, "Newsgroups: ", 12)) {
+    strcpy(filename, "News:");
+    strcat(filename, line + 12);
+    copyheader(hdrs.to, filename, 79);
+    hdrs.to[79] = '\0';
+  }
+  if (!strncmp(line, "Organization: ", 14)) {
+    copyheader(hdrs.cc, line + 14, 79);
+    hdrs.cc[79] = '\0';
+  }
+  if (!strncmp(line, "Subject: ", 9)) {
+    copyheader(hdrs.subject, line + 9, 79);
+    hdrs.subject[79] = '\0';
   }
-  headers = 1;
-  headerchars = 0;
-  hdrs.skipbytes = 0; // Just in case it doesn't get set
+}
+
+/*
+ * Start the NEWS.SENT copy of the message about to be sent
+ * The copy is written while the message is being sent, so each message
+ * is only read from NEWS.OUTBOX once.
+ */
+void sent_start(void) {
+  sprintf(filename, "%s/NEWS.SENT/EMAIL.%u", cfg_emaildir, nextemail);
+  if (sent_open(filename, linebuf, LINEBUFSZ, sent_header))
+    error_exit();
+  memset(&hdrs, 0, sizeof(hdrs));
+  hdrs.emailnum = nextemail;
   hdrs.status = 'N';
   hdrs.tag = ' ';
-  get_line(fp, 1, linebuf, LINEBUFSZ); // Reset buffer
-  while ((chars = get_line(fp, 0, linebuf, LINEBUFSZ)) != 0) {
-    if (headers) {
-      headerchars += chars;
-      if (!strncmp(linebuf, "Date: ", 6)) {
-        copyheader(hdrs.date, linebuf + 6, 39);
-        hdrs.date[39] = '\0';
-      }
-      if (!strncmp(linebuf, "From: ", 6)) {
-        copyheader(hdrs.from, linebuf + 6, 79);
-        hdrs.from[79] = '\0';
-      }
-      if (!strncmp(linebuf, "Newsgroups: ", 12)) {
-        strcpy(filename, "News:");
-        strcat(filename, linebuf + 12);
-        copyheader(hdrs.to, filename, 79);
-        hdrs.to[79] = '\0';
-      }
-      if (!strncmp(linebuf, "Organization: ", 14)) {
-        copyheader(hdrs.cc, linebuf + 14, 79);
-        hdrs.cc[79] = '\0';
-      }
-      if (!strncmp(linebuf, "Subject: ", 9)) {
-        copyheader(hdrs.subject, linebuf + 9, 79);
-        hdrs.subject[79] = '\0';
-      }
-      if (linebuf[0] == '\r') {
-        headers = 0;
-        hdrs.skipbytes = headerchars;
-      }
-    }
-    fputs(linebuf, destfp);
+}
+
+/*
+ * Message was sent okay, add the NEWS.SENT copy to the mailbox
+ */
+void sent_commit(void) {
+  hdrs.skipbytes = sent_close();
+  update_email_db(&hdrs);
+  write_next_email(++nextemail);
+}
+
+/*
+ * Ask the server what it supports (RFC 3977 CAPABILITIES)
+ * If it offers STREAMING, switch to MODE STREAM (RFC 4644) so that
+ * articles can be sent back to back with TAKETHIS. Servers normally
+ * only offer this to peers, such as a local news server which the
+ * Apple II feeds, not to newsreaders.
+ */
+void get_capabilities(void) {
+  if (!w5100_tcp_send_recv("CAPABILITIES\r\n", buf, NETBUFSZ,
+                           DO_SEND, CMD_MODE))
+    error_exit();
+  if (strncmp(buf, "101", 3))
+    return; // Older server, use POST
+  while (1) {
+    if (!w5100_get_line(buf, NETBUFSZ))
+      error_exit();
+    if ((buf[0] == '.') && (buf[1] == '\r'))
+      break;
+    if (!strncmp(buf, "STREAMING", 9))
+      streaming = 1;
+  }
+  if (!streaming)
+    return;
+  if (!w5100_tcp_send_recv("MODE STREAM\r\n", buf, NETBUFSZ,
+                           DO_SEND, CMD_MODE))
+    error_exit();
+  if (strncmp(buf, "203", 3))
+    streaming = 0;
+}
+
+/*
+ * Read the reply to the oldest article in window[]
+ * 239 - accepted, add it to NEWS.SENT and remove it from NEWS.OUTBOX
+ * 439 - refused, throw away the NEWS.SENT copy. The server must not be
+ *       offered it again with TAKETHIS (RFC 4644), so it is sent with
+ *       POST once the streamed articles are done.
+ * Anything else means the server has given up on us.
+ */
+void stream_reply(void) {
+  struct streament *e = &window[winfirst];
+  if (!w5100_tcp_send_recv(NULL, buf, NETBUFSZ, DONT_SEND, CMD_MODE))
+    error_exit();
+  if (!strncmp(buf, "239", 3)) {
+    update_email_db(&(e->hdrs));
+    write_next_email(e->hdrs.emailnum + 1);
+    sprintf(filename, "%s/NEWS.OUTBOX/%s", cfg_emaildir, e->name);
+    if (unlink(filename))
+      printf("Can't remove %s\n", filename);
+  } else {
+    // Refused, or the server could not take it just now
+    sprintf(filename, "%s/NEWS.SENT/EMAIL.%u", cfg_emaildir, e->hdrs.emailnum);
+    unlink(filename);
+    if (!strncmp(buf, "439", 3) && (nrefused < REFUSEDMAX)) {
+      printf("Refused, will POST %s\n", e->name);
+      strcpy(refused[nrefused++], e->name);
+    } else
+      printf("Refused, holding %s\n", e->name);
+  }
+  winfirst = (winfirst + 1) % STREAMWIN;
+  --waiting;
+}
+
+/*
+ * Send the open article fp with TAKETHIS, without waiting for the reply
+ * The NEWS.SENT copy is written as it goes, but only added to the mailbox
+ * once stream_reply() sees that it was accepted. If the article has no
+ * Path header one is added in front, as a peer expects one on every
+ * article it is offered.
+ * name - file name in NEWS.OUTBOX
+ */
+void stream_article(char *name) {
+  static char cmd[120];
+  struct streament *e;
+
+  if (waiting == STREAMWIN)
+    stream_reply();
+
+  sprintf(cmd, "TAKETHIS %s\r\n", msgid);
+  putchar('>');
+  print_strip_crlf(cmd);
+  if (needpath)
+    strcat(cmd, "Path: not-for-mail\r\n");
+
+  sent_start();
+  if (!w5100_send_text(cmd) || !w5100_send_body())
+    error_exit();
+  hdrs.skipbytes = sent_close();
+
+  e = &window[(winfirst + waiting) % STREAMWIN];
+  strcpy(e->name, name);
+  memcpy(&(e->hdrs), &hdrs, sizeof(hdrs));
+  ++waiting;
+  ++nextemail;
+}
+
+/*
+ * Send the open article fp with POST and wait for the reply
+ * If it is accepted, it is added to NEWS.SENT and removed from
+ * NEWS.OUTBOX. Either way fp is closed.
+ * name - file name in NEWS.OUTBOX
+ */
+void post_article(char *name) {
+  // POST replies must not be mixed up with those still due for TAKETHIS
+  while (waiting)
+    stream_reply();
+
+  if (!w5100_tcp_send_recv("POST\r\n", buf, NETBUFSZ, DO_SEND, CMD_MODE)) {
+    error_exit();
+  }
+  if (expect(buf, "340"))
+    error_exit();
+
+  fseek(fp, 0, SEEK_SET);
+
+  // NEWS.SENT copy is written as the article goes out
+  sent_start();
+
+  if (!w5100_tcp_send_recv(NULL, buf, NETBUFSZ, DO_SEND, DATA_MODE)) {
+    error_exit();
   }
   fclose(fp);
-  fclose(destfp);
-  update_email_db(&hdrs);
-  write_next_email(nextemail);
+  fp = NULL;
+  if (expect(buf, "240")) {
+    sent_abort();
+    printf("Skipping msg\n");
+    return;
+  }
+
+  printf("Updating NEWS.SENT mailbox ...\n");
+  sent_commit();
+
+  printf("Removing from NEWS.OUTBOX ...\n");
+  sprintf(filename, "%s/NEWS.OUTBOX/%s", cfg_emaildir, name);
+  if (unlink(filename))
+    printf("Can't remove %s\n", filename);
 }
 
 void main(int argc, char *argv[]) {
   static char sendbuf[80];
-  uint8_t linecount;
+  uint8_t linecount, haspath, i;
   DIR *dp;
   struct dirent *d;
   char c;
   uint8_t eth_init = ETH_INIT_DEFAULT, connected = 0;
 
-  if ((argc == 2) && (strcmp(argv[1], "EMAIL") == 0))
-    exec_email_on_exit = 1;
+  // EMAIL - return to EMAIL.SYSTEM on exit
+  // BATCH - send all messages without asking
+  // SYNC  - send all messages, then run the next program of a SYNC65 run
+  while (--argc) {
+    if (strcmp(argv[argc], "EMAIL") == 0)
+      exec_email_on_exit = 1;
+    else if (strcmp(argv[argc], "BATCH") == 0)
+      batch = sendall = 1;
+    else if (strcmp(argv[argc], "SYNC") == 0)
+      chained = sendall = 1;
+  }
 
   videomode(VIDEOMODE_80COL);
   printf("%c%s NNTP Post News Article(s)%c\n", 0x0f, PROGNAME, 0x0e);
@@ -533,24 +583,30 @@ void main(int argc, char *argv[]) {
     }
   }
 
-  printf("%d\nInitializing %s     - ", eth_init, eth_name);
-  if (ip65_init(eth_init)) {
-    ip65_error_exit();
-  }
-
   // Abort on Ctrl-C to be consistent with Linenoise
   abort_key = 0x83;
 
-  printf("Ok\nObtaining IP address         - ");
-  if (dhcp_init()) {
-    ip65_error_exit();
+  if (chained && chain_net_load(&eth_init)) {
+    printf("%d\nUsing network from SYNC65    - Ok\n", eth_init);
+  } else {
+    printf("%d\nInitializing %s     - ", eth_init, eth_name);
+    if (ip65_init(eth_init)) {
+      ip65_error_exit();
+    }
+
+    printf("Ok\nObtaining IP address         - ");
+    if (dhcp_init()) {
+      ip65_error_exit();
+    }
+    printf("Ok\n");
   }
-  printf("Ok\n");
 
   // Copy IP config from IP65 to W5100
   w5100_init(eth_init);
   w5100_config();
 
+  read_next_email();
+
   sprintf(filename, "%s/NEWS.OUTBOX", cfg_emaildir);
   dp = opendir(filename);
   if (!dp) {
@@ -576,18 +632,38 @@ void main(int argc, char *argv[]) {
     printf("\n** Processing file %s ...\n", d->d_name);
 
     linecount = 0;
+    msgid[0] = '\0';
+    needpath = haspath = 0;
+    get_line(fp, 1, linebuf, LINEBUFSZ); // Reset buffer
 
     while (1) {
-      if ((get_line(fp, 0, linebuf, LINEBUFSZ) == 0) || (linecount == 20) || (linebuf[0] == '\r'))
+      if ((get_line(fp, 0, linebuf, LINEBUFSZ) == 0) || (linecount == 20))
+        break;
+      if (linebuf[0] == '\r') {
+        // Only add Path once all the headers have been seen
+        needpath = !haspath;
         break;
+      }
       ++linecount;
+      if (!strncasecmp(linebuf, "Path:", 5))
+        haspath = 1;
       if (!strncmp(linebuf, "Newsgroups: ", 12))
         printf("%s", linebuf);
       if (!strncmp(linebuf, "Subject: ", 9))
         printf("%s", linebuf);
+      if (!strncmp(linebuf, "Message-ID: ", 12) &&
+          (strlen(linebuf + 12) < sizeof(msgid))) {
+        strcpy(msgid, linebuf + 12);
+        msgid[strlen(msgid) - 1] = '\0'; // Chop off \r
+      }
     }
 
-    printf("\n%cS)end message | H)old message in NEWS.OUTBOX | D)elete message from NEWS.OUTBOX%c",
+    // Don't stop to ask in BATCH mode, during a SYNC65 run or once
+    // A)ll has been chosen
+    if (sendall)
+      goto sendmessage;
+
+    printf("\n%cS)end message | A)ll remaining | H)old in NEWS.OUTBOX | D)elete from NEWS.OUTBOX%c",
            INVERSE, NORMAL);
     while (1) {
       c = cgetc();
@@ -595,10 +671,15 @@ void main(int argc, char *argv[]) {
       case 'S':
       case 's':
         goto sendmessage;
+      case 'A':
+      case 'a':
+        sendall = 1;
+        goto sendmessage;
       case 'H':
       case 'h':
         printf("\n  Holding message\n");
         fclose(fp);
+        fp = NULL;
         goto skiptonext;
       case 'D':
       case 'd':
@@ -611,12 +692,14 @@ void main(int argc, char *argv[]) {
             putchar(CLRLINE);
             printf("\n  Deleting message\n");
             fclose(fp);
+            fp = NULL;
             goto unlink;
           case 'N':
           case 'n':
             putchar(CLRLINE);
             printf("\n  Holding message\n");
             fclose(fp);
+            fp = NULL;
             goto skiptonext;
           default:
             putchar(BELL);
@@ -663,29 +746,16 @@ sendmessage:
           error_exit();
       }
 
+      get_capabilities();
       connected = 1;
     }
 
-    if (!w5100_tcp_send_recv("POST\r\n", buf, NETBUFSZ, DO_SEND, CMD_MODE)) {
-      error_exit();
-    }
-    if (expect(buf, "340"))
-      error_exit();
-
-    fseek(fp, 0, SEEK_SET);
-
-    if (!w5100_tcp_send_recv(sendbuf, buf, NETBUFSZ, DO_SEND, DATA_MODE)) {
-      error_exit();
-    }
-    expect(buf, "240");
-
-    fclose(fp);
-
-    printf("Updating NEWS.SENT mailbox ...\n");
-    update_sent_mbox(d->d_name);
-
-    printf("Removing from NEWS.OUTBOX ...\n");
-    sprintf(filename, "%s/NEWS.OUTBOX/%s", cfg_emaildir, d->d_name);
+    // Articles without a Message-ID can only be sent with POST
+    if (streaming && msgid[0])
+      stream_article(d->d_name);
+    else
+      post_article(d->d_name);
+    goto skiptonext;
 
 unlink:
     if (unlink(filename))
@@ -697,6 +767,22 @@ skiptonext:
   }
   closedir(dp);
 
+  // Collect the replies to any streamed articles still outstanding
+  while (waiting)
+    stream_reply();
+
+  // Articles refused by TAKETHIS may still be accepted by POST
+  for (i = 0; i < nrefused; ++i) {
+    printf("\n** Posting refused article %s ...\n", refused[i]);
+    sprintf(filename, "%s/NEWS.OUTBOX/%s", cfg_emaildir, refused[i]);
+    fp = fopen(filename, "rb");
+    if (!fp) {
+      printf("Can't open %s\n", refused[i]);
+      continue;
+    }
+    post_article(refused[i]);
+  }
+
   // Ignore any error - can be a race condition where other side
   // disconnects too fast and we get an error
   if (connected) {
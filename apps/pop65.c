@@ -21,6 +21,8 @@
 #include "w5100.h"
 
 #include "email_common.h"
+#include "chain.h"
+#include "codec.h"
 
 #define BACKSPACE 8
 
@@ -38,6 +40,7 @@ static char          linebuf_pad[1];     // One byte of padding make it easier
 static char          linebuf[LINEBUFSZ];
 
 uint8_t  exec_email_on_exit = 0;
+uint8_t  chained = 0;     // 1 if run as part of SYNC65
 char     filename[80];
 int      len;
 FILE     *fp;
@@ -50,6 +53,8 @@ uint16_t pop_port;
 void confirm_exit(void) {
   fclose(fp);
   w5100_disconnect();
+  if (chained)
+    chain_exec(cfg_instdir, CHAIN_SMTP, exec_email_on_exit);
   printf("\n[Press Any Key]");
   cgetc();
   if (exec_email_on_exit) {
@@ -421,6 +426,7 @@ void update_inbox(uint16_t nummsgs) {
   static struct emailhdrs hdrs;
   uint16_t nextemail, msg, chars, headerchars;
   uint8_t headers;
+  char *lasthdr;
   FILE *destfp;
   sprintf(filename, "%s/INBOX/NEXT.EMAIL", cfg_emaildir);
   fp = fopen(filename, "r");
@@ -439,6 +445,7 @@ void update_inbox(uint16_t nummsgs) {
       printf("Can't open %s\n", filename);
       error_exit();
     }
+    memset(&hdrs, 0, sizeof(hdrs));
     hdrs.emailnum = nextemail;
     sprintf(filename, "%s/INBOX/EMAIL.%u", cfg_emaildir, nextemail++);
     puts(filename);
@@ -452,19 +459,25 @@ void update_inbox(uint16_t nummsgs) {
     }
     headers = 1;
     headerchars = 0;
+    lasthdr = NULL;
     hdrs.skipbytes = 0; // Just in case it doesn't get set
     hdrs.status = 'N';
     hdrs.tag = ' ';
     while ((chars = get_line(fp, linebuf, LINEBUFSZ)) != 0) {
       if (headers) {
         headerchars += chars;
+        if ((linebuf[0] == ' ') || (linebuf[0] == '\t')) {
+          if (lasthdr) // Folded From or Subject
+            decode_header(lasthdr, linebuf, 80);
+        } else
+          lasthdr = NULL;
         if (!strncmp(linebuf, "Date: ", 6)) {
           copyheader(hdrs.date, linebuf + 6, 39);
           hdrs.date[39] = '\0';
         }
         if (!strncmp(linebuf, "From: ", 6)) {
-          copyheader(hdrs.from, linebuf + 6, 79);
-          hdrs.from[79] = '\0';
+          decode_header(hdrs.from, linebuf + 6, 80);
+          lasthdr = hdrs.from;
         }
         if (!strncmp(linebuf, "To: ", 4)) {
           copyheader(hdrs.to, linebuf + 4, 79);
@@ -475,8 +488,8 @@ void update_inbox(uint16_t nummsgs) {
           hdrs.cc[79] = '\0';
         }
         if (!strncmp(linebuf, "Subject: ", 9)) {
-          copyheader(hdrs.subject, linebuf + 9, 79);
-          hdrs.subject[79] = '\0';
+          decode_header(hdrs.subject, linebuf + 9, 80);
+          lasthdr = hdrs.subject;
         }
         if (linebuf[0] == '\r') {
           headers = 0;
@@ -502,8 +515,14 @@ void main(int argc, char *argv[]) {
   uint16_t msg, nummsgs;
   uint32_t bytes;
 
-  if ((argc == 2) && (strcmp(argv[1], "EMAIL") == 0))
-    exec_email_on_exit = 1;
+  // EMAIL - return to EMAIL.SYSTEM on exit
+  // SYNC  - run the next program of a SYNC65 run on exit
+  while (--argc) {
+    if (strcmp(argv[argc], "EMAIL") == 0)
+      exec_email_on_exit = 1;
+    else if (strcmp(argv[argc], "SYNC") == 0)
+      chained = 1;
+  }
 
   linebuf_pad[0] = 0;
 
@@ -526,19 +545,24 @@ void main(int argc, char *argv[]) {
     }
   }
 
-  printf("%d\nInitializing %s     - ", eth_init, eth_name);
-  if (ip65_init(eth_init)) {
-    ip65_error_exit();
-  }
-
   // Abort on Ctrl-C to be consistent with Linenoise
   abort_key = 0x83;
 
-  w5100_init(eth_init);
+  if (chained && chain_net_load(&eth_init)) {
+    printf("%d\nUsing network from SYNC65    - ", eth_init);
+    w5100_init(eth_init);
+  } else {
+    printf("%d\nInitializing %s     - ", eth_init, eth_name);
+    if (ip65_init(eth_init)) {
+      ip65_error_exit();
+    }
+
+    w5100_init(eth_init);
 
-  printf("Ok\nObtaining IP address         - ");
-  if (dhcp_init()) {
-    ip65_error_exit();
+    printf("Ok\nObtaining IP address         - ");
+    if (dhcp_init()) {
+      ip65_error_exit();
+    }
   }
 
   // Copy IP config from IP65 to W5100
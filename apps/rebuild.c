@@ -16,6 +16,7 @@
 #include <dirent.h>
 #include <apple2_filetype.h>
 #include "email_common.h"
+#include "codec.h"
 
 #define NETBUFSZ  1500+4       // 4 extra bytes for overlap between packets
 #define LINEBUFSZ 1000         // According to RFC2822 Section 2.1.1 (998+CRLF)
@@ -131,6 +132,7 @@ void repair_mailbox(void) {
   static struct emailhdrs hdrs;
   uint16_t chars, headerchars, emailnum, minemailnum, maxemailnum;
   uint8_t headers;
+  char *lasthdr;
   FILE *fp;
   DIR *dp;
   struct dirent *d;
@@ -197,6 +199,8 @@ void repair_mailbox(void) {
     printf("** Processing file %s\n", filename);
     headers = 1;
     headerchars = 0;
+    lasthdr = NULL;
+    memset(&hdrs, 0, sizeof(hdrs));
     hdrs.emailnum = emailnum;
     hdrs.skipbytes = 0; // Just in case it doesn't get set
     hdrs.status = 'R';
@@ -204,13 +208,18 @@ void repair_mailbox(void) {
     while ((chars = get_line(fp, linebuf, LINEBUFSZ)) != 0) {
       if (headers) {
         headerchars += chars;
+        if ((linebuf[0] == ' ') || (linebuf[0] == '\t')) {
+          if (lasthdr) // Folded From or Subject
+            decode_header(lasthdr, linebuf, 80);
+        } else
+          lasthdr = NULL;
         if (!strncmp(linebuf, "Date: ", 6)) {
           copyheader(hdrs.date, linebuf + 6, 39);
           hdrs.date[39] = '\0';
         }
         if (!strncmp(linebuf, "From: ", 6)) {
-          copyheader(hdrs.from, linebuf + 6, 79);
-          hdrs.from[79] = '\0';
+          decode_header(hdrs.from, linebuf + 6, 80);
+          lasthdr = hdrs.from;
         }
         if (!strncmp(linebuf, "To: ", 4)) {
           copyheader(hdrs.to, linebuf + 4, 79);
@@ -221,8 +230,8 @@ void repair_mailbox(void) {
           hdrs.cc[79] = '\0';
         }
         if (!strncmp(linebuf, "Subject: ", 9)) {
-          copyheader(hdrs.subject, linebuf + 9, 79);
-          hdrs.subject[79] = '\0';
+          decode_header(hdrs.subject, linebuf + 9, 80);
+          lasthdr = hdrs.subject;
         }
         if (linebuf[0] == '\r') {
           headers = 0;
@@ -0,0 +1,101 @@
+/////////////////////////////////////////////////////////////////
+// SENTCOPY.C
+// Writing the SENT or NEWS.SENT copy of a message while it is
+// being sent, so it is only read from the outbox once
+// Shared between smtp65.c and nntp65.up.c
+/////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <apple2_filetype.h>
+
+#include "sentcopy.h"
+
+static FILE     *fp;            // SENT copy being written
+static char     path[80];       // Path of that file
+static char     *linebuf;       // Header line being collected
+static uint16_t linesz;         // Size of linebuf[]
+static uint16_t linelen;        // Chars in linebuf[] so far
+static uint16_t headerchars;    // Length of headers so far
+static uint8_t  in_headers;     // 1 until the blank line after the headers
+static void     (*hdrfn)(char *line);
+
+/*
+ * Start the copy of a message about to be sent
+ * name - file to write the copy to
+ * line - buffer for collecting header lines
+ * n - size of line[]
+ * header - called with each header line, ending in CR, and with the
+ *          blank line which ends the headers
+ * Returns 0 if okay, 1 if the file could not be created
+ */
+uint8_t sent_open(char *name, char *line, uint16_t n,
+                  void (*header)(char *line)) {
+  strncpy(path, name, 79);
+  path[79] = '\0';
+  _filetype = PRODOS_T_TXT;
+  _auxtype = 0;
+  fp = fopen(path, "wb");
+  if (!fp) {
+    printf("Can't open %s\n", path);
+    return 1;
+  }
+  linebuf = line;
+  linesz = n;
+  linelen = 0;
+  headerchars = 0;
+  in_headers = 1;
+  hdrfn = header;
+  return 0;
+}
+
+/*
+ * Append a block of the message being sent to the copy
+ * Header lines are collected and passed to the header function as they
+ * go past.
+ * p - block of message
+ * n - number of bytes in p[]
+ * Returns 0 if okay, 1 on write error
+ */
+uint8_t sent_write(char *p, uint16_t n) {
+  uint16_t i;
+  char c;
+  if (fwrite(p, 1, n, fp) != n) {
+    printf("Can't write %s\n", path);
+    return 1;
+  }
+  for (i = 0; in_headers && (i < n); ++i) {
+    c = p[i];
+    ++headerchars;
+    if (linelen < linesz - 1)
+      linebuf[linelen++] = c;
+    if (c == '\r') {
+      linebuf[linelen] = '\0';
+      if (linelen == 1)
+        in_headers = 0;
+      hdrfn(linebuf);
+      linelen = 0;
+    }
+  }
+  return 0;
+}
+
+/*
+ * Message was sent okay, close the copy
+ * Returns the length of the headers, for skipbytes in EMAIL.DB, or 0 if
+ * the end of the headers was not seen
+ */
+uint16_t sent_close(void) {
+  fclose(fp);
+  return (in_headers ? 0 : headerchars);
+}
+
+/*
+ * Message was not sent, throw away the copy
+ */
+void sent_abort(void) {
+  fclose(fp);
+  unlink(path);
+}
@@ -0,0 +1,19 @@
+/////////////////////////////////////////////////////////////////
+// SENTCOPY.H
+// Writing the SENT or NEWS.SENT copy of a message while it is
+// being sent, so it is only read from the outbox once
+// Shared between smtp65.c and nntp65.up.c
+/////////////////////////////////////////////////////////////////
+
+#ifndef _SENTCOPY_H_
+#define _SENTCOPY_H_
+
+#include <stdint.h>
+
+uint8_t sent_open(char *name, char *line, uint16_t n,
+                  void (*header)(char *line));
+uint8_t sent_write(char *p, uint16_t n);
+uint16_t sent_close(void);
+void sent_abort(void);
+
+#endif
@@ -22,6 +22,9 @@
 #include "w5100.h"
 
 #include "email_common.h"
+#include "chain.h"
+#include "netio.h"
+#include "sentcopy.h"
 
 #define BELL      7
 #define BACKSPACE 8
@@ -37,23 +40,63 @@
 #define NETBUFSZ  1500
 #define LINEBUFSZ 1000         // According to RFC2822 Section 2.1.1 (998+CRLF)
 #define READSZ    1024         // Must be less than NETBUFSZ to fit in buf[]
+#define SYSTEMTIME 0xbf90      // ProDOS date/time
+
+#define QUEUEMAX  64           // Max number of messages tracked in QUEUE.DB
+#define MAXTRIES  10           // Give up after this many temporary failures
+#define RETRYMINS 15           // First retry delay, doubled each failure
+
+/*
+ * Delivery state of one message in OUTBOX, kept in OUTBOX/QUEUE.DB
+ */
+struct queueent {
+  char     name[16];           // Filename in OUTBOX, empty if unused
+  char     state;              // 'Q'ueued, 'R'etry, 'H'eld or 'F'ailed
+  uint8_t  attempts;           // Number of failed attempts so far
+  uint32_t retry;              // Time of next attempt, in minutes
+  char     error[42];          // Server reply for last failure
+};
 
 static unsigned char buf[NETBUFSZ+1];    // One extra byte for null terminator
 static char          linebuf[LINEBUFSZ];
 
 uint8_t  exec_email_on_exit = 0;
+uint8_t  chained = 0;     // 1 if run as part of SYNC65
 char     filename[80];
 int      len;
 FILE     *fp;
+uint16_t nextemail;       // Number of next SENT/EMAIL.n
+static struct emailhdrs hdrs; // Headers of message being sent
 uint32_t filesize;
 uint16_t smtp_port;
+uint8_t  pipelining = 0;  // 1 if server supports ESMTP PIPELINING
+uint8_t  chunking = 0;    // 1 if server supports ESMTP CHUNKING (BDAT)
+uint8_t  eightbit = 0;    // 1 if server supports ESMTP 8BITMIME
+uint8_t  batch = 0;       // 1 if running without user interaction
+static struct queueent queue[QUEUEMAX];
+static struct queueent spare; // Used if the queue is full
+struct queueent *cur;     // Entry for message being sent, or NULL
+uint8_t  queuelen;        // Number of entries in queue[]
+uint8_t  queueloaded;     // 1 once QUEUE.DB has been read
+uint8_t  seen[QUEUEMAX];  // 1 if file for queue[] entry is in OUTBOX
+uint32_t now;             // Current time in minutes, 0 if no clock
+char     lasterr[42];     // Last unexpected reply from server
+
+void queue_fail(uint8_t permanent);
+
+/* Defined in gettime.s */
+void gettime(void);
 
 /*
  * Keypress before quit
  */
 void confirm_exit(void) {
-  printf("\n[Press Any Key]");
-  cgetc();
+  if (chained)
+    chain_exec(cfg_instdir, CHAIN_NNTP_DOWN, exec_email_on_exit);
+  if (!batch) {
+    printf("\n[Press Any Key]");
+    cgetc();
+  }
   if (exec_email_on_exit) {
     sprintf(filename, "%s/EMAIL.SYSTEM", cfg_instdir);
     exec(filename, NULL);
@@ -65,6 +108,12 @@ void confirm_exit(void) {
  * Called for all non IP65 errors
  */
 void error_exit() {
+  if (cur) {
+    // Leave the message in OUTBOX to be tried again later
+    if (!lasterr[0])
+      strcpy(lasterr, "Connection failed");
+    queue_fail(0);
+  }
   confirm_exit();
 }
 
@@ -150,8 +199,94 @@ done:
 #define CMD_MODE  0  // For mode param
 #define DATA_MODE 1  // For mode param
 
+// Send the message body from file fp as DATA, followed by the terminating
+// "." line.
+// The file is read in blocks of READSZ bytes into buf[] and each block is
+// sent by w5100_send_crlf() with dot-stuffing, as required by RFC 5321.
+bool w5100_send_body(void) {
+  uint16_t end;
+
+  filesize = 0;
+  w5100_crlf_start();
+  fseek(fp, 0, SEEK_SET);
+
+  while ((end = fread(buf, 1, READSZ, fp)) != 0) {
+    if (sent_write((char*)buf, end))
+      error_exit();
+    filesize += end;
+    spinner(filesize, 0);
+    if (!w5100_send_crlf((char*)buf, end, 1))
+      return false;
+  }
+  spinner(filesize, 1);
+
+  return w5100_send_dot();
+}
+
+// Receive one complete reply from the server
+// Multi-line replies ("250-...") are read up to and including the last
+// line ("250 ..."). Only the bytes of this reply are taken from the W5100,
+// so when commands have been pipelined the following replies are left
+// for the next call.
+// recvbuf is the buffer into which the reply will be written. If the reply
+// is too long it is truncated, but all of it is still consumed.
+// length is the length of recvbuf[]
+bool w5100_get_reply(char *recvbuf, size_t length) {
+  uint16_t rcv;
+  uint16_t len = 0;
+  uint16_t i;
+  uint8_t col = 0;  // Column in current line
+  char sep = ' ';   // Char after reply code, '-' if more lines follow
+
+  --length; // Leave space for NULL at end
+
+  while (1) {
+    if (input_check_for_abort_key()) {
+      printf("User abort\n");
+      w5100_disconnect();
+      return false;
+    }
+
+    rcv = w5100_receive_request();
+    if (!rcv) {
+      if (!w5100_connected()) {
+        recvbuf[len] = '\0';
+        printf("Connection lost\n");
+        return false;
+      }
+      continue;
+    }
+
+    for (i = 0; i < rcv; ) {
+      // The variable is necessary to have cc65 generate code
+      // suitable to access the W5100 auto-increment register.
+      char data = *w5100_data;
+      ++i;
+      if (len < length)
+        recvbuf[len++] = data;
+      if (col == 3)
+        sep = data;
+      if (col < 4)
+        ++col;
+      if (data == '\n') {
+        if (sep != '-')
+          goto done;
+        col = 0;
+        sep = ' ';
+      }
+    }
+    w5100_receive_commit(rcv);
+  }
+done:
+  w5100_receive_commit(i);
+  recvbuf[len] = '\0';
+  putchar('<');
+  print_strip_crlf(recvbuf);
+  return true;
+}
+
 // Modified verson of w5100_http_open from w5100_http.c
-// Sends a TCP message and receives a the first packet of the response.
+// Sends a TCP message and receives the response.
 // sendbuf is the buffer to send (null terminated)
 // recvbuf is the buffer into which the received message will be written
 // length is the length of recvbuf[]
@@ -166,180 +301,39 @@ bool w5100_tcp_send_recv(char* sendbuf, char* recvbuf, size_t length,
       //
       // Handle sending of email body
       //
-      uint16_t pos = 0;
-      uint8_t  cont = 1;
-      uint16_t snd;
-      uint16_t len;
-
-      filesize = 0;
-      len = get_line(fp, 1, linebuf, LINEBUFSZ); // Reset buffer
-
-      while (cont) { 
-
-        len = get_line(fp, 0, linebuf, LINEBUFSZ - 1);
-        pos = 0;
-
-        if (len == 0) {
-          strcpy(linebuf, "\r\n.\r\n");
-          len = 5;
-          cont = 0;
-        } else {
-          linebuf[len++] = '\n'; // CR -> CRLF
-          linebuf[len] = '\0';
-          filesize += len;
-        }
-
-        while (len) {
-          if (input_check_for_abort_key())
-          {
-            printf("User abort\n");
-            w5100_disconnect();
-            return false;
-          }
-
-          snd = w5100_send_request();
-          if (!snd) {
-            if (!w5100_connected()) {
-              printf("Connection lost\n");
-              return false;
-            }
-            continue;
-          }
-
-          if (len < snd)
-            snd = len;
-
-          {
-            // One less to allow for faster pre-increment below
-            const char *dataptr = linebuf + pos - 1;
-            uint16_t i;
-            for (i = 0; i < snd; ++i) {
-              // The variable is necessary to have cc65 generate code
-              // suitable to access the W5100 auto-increment register.
-              char data = *++dataptr;
-              *w5100_data = data;
-            }
-          }
-
-          w5100_send_commit(snd);
-          len -= snd;
-          pos += snd;
-        }
-        spinner(filesize, 0);
-      }
-      spinner(filesize, 1);
+      if (!w5100_send_body())
+        return false;
 
     } else {
       //
       // Handle short ASCII text transmissions
       //
-      uint16_t snd;
-      uint16_t pos = 0;
-      uint16_t len = strlen(sendbuf);
-
       putchar('>');
       print_strip_crlf(sendbuf);
-
-      while (len) {
-        if (input_check_for_abort_key())
-        {
-          printf("User abort\n");
-          w5100_disconnect();
-          return false;
-        }
-
-        snd = w5100_send_request();
-        if (!snd) {
-          if (!w5100_connected()) {
-            printf("Connection lost\n");
-            return false;
-          }
-          continue;
-        }
-
-        if (len < snd)
-          snd = len;
-
-        {
-          // One less to allow for faster pre-increment below
-          const char *dataptr = sendbuf + pos - 1;
-          uint16_t i;
-          for (i = 0; i < snd; ++i) {
-            // The variable is necessary to have cc65 generate code
-            // suitable to access the W5100 auto-increment register.
-            char data = *++dataptr;
-            *w5100_data = data;
-          }
-        }
-
-        w5100_send_commit(snd);
-        len -= snd;
-        pos += snd;
-      }
-    }
-  }
-
-  {
-    //
-    // Handle short single packet ASCII text responses
-    // Must fit in recvbuf[]
-    //
-    uint16_t rcv;
-    uint16_t len = 0;
-    uint8_t cont = 1;
-
-    --length; // Leave space for NULL at end in case of buffer overrun
-
-    while (cont) {
-      if (input_check_for_abort_key()) {
-        printf("User abort\n");
-        w5100_disconnect();
+      if (!w5100_send_text(sendbuf))
         return false;
-      }
-    
-      rcv = w5100_receive_request();
-      if (!rcv) {
-        cont = w5100_connected();
-        if (cont)
-          continue;
-      }
-
-      if ((length - len) == 0)
-        cont = 0;
-
-      if (rcv > length - len)
-        rcv = length - len;
-
-      {
-        // One less to allow for faster pre-increment below
-        char *dataptr = recvbuf + len - 1;
-        uint16_t i;
-        for (i = 0; i < rcv; ++i) {
-          // The variable is necessary to have cc65 generate code
-          // suitable to access the W5100 auto-increment register.
-          char data = *w5100_data;
-          *++dataptr = data;
-          if (!memcmp(dataptr - 1, "\r\n", 2))
-            cont = 0;
-        }
-      }
-      w5100_receive_commit(rcv);
-      len += rcv;
     }
-    recvbuf[len + 1] = '\0';
-    putchar('<');
-    print_strip_crlf(recvbuf);
   }
-  return true;
+
+  return w5100_get_reply(recvbuf, length);
 }
 
 /*
  * Check expected string from server
+ * The first line of a multi-line reply has '-' after the code, which is
+ * accepted in place of the space in s.
  * Returns 0 if expected, 1 otherwise
  */
 uint8_t expect(char *buf, char *s) {
+  char *p;
+  if ((buf[3] == '-') && (s[3] == ' ') && !strncmp(buf, s, 3))
+    return 0;
   if (strncmp(buf, s, strlen(s)) != 0) {
     printf("\nExpected '%s' got '%s'\n", s, buf);
+    strncpy(lasterr, buf, sizeof(lasterr) - 1);
+    p = strchr(lasterr, '\r');
+    if (p)
+      *p = '\0';
     return 1;
   }
   return 0;
@@ -409,6 +403,7 @@ void copyheader(char *dest, char *source, uint16_t len) {
  * Write NEXT.EMAIL file with number of next EMAIL.n file to be created
  */
 void write_next_email(uint16_t num) {
+  FILE *fp;
   sprintf(filename, "%s/SENT/NEXT.EMAIL", cfg_emaildir);
   _filetype = PRODOS_T_TXT;
   _auxtype = 0;
@@ -423,16 +418,10 @@ void write_next_email(uint16_t num) {
 }
 
 /*
- * Update SENT when a message has been sent
- * Copy a messages from OUTBOX to SENT and find headers of interest
- * (Date, From, To, BCC, Subject)
- * filename - Filename in OUTBOX for message just sent
+ * Read SENT/NEXT.EMAIL once at start up
  */
-void update_sent_mbox(char *name) {
-  static struct emailhdrs hdrs;
-  uint16_t nextemail, chars, headerchars;
-  uint8_t headers;
-  FILE *destfp;
+void read_next_email(void) {
+  FILE *fp;
   sprintf(filename, "%s/SENT/NEXT.EMAIL", cfg_emaildir);
   fp = fopen(filename, "r");
   if (!fp) {
@@ -442,64 +431,342 @@ void update_sent_mbox(char *name) {
     fscanf(fp, "%u", &nextemail);
     fclose(fp);
   }
-  strcpy(linebuf, "");
-  sprintf(filename, "%s/OUTBOX/%s", cfg_emaildir, name);
-  fp = fopen(filename, "r");
-  if (!fp) {
-    printf("Can't open %s\n", filename);
-    error_exit();
+}
+
+/*
+ * Record a header of interest (Date, From, To, Cc, Subject)
+ * Called by sent_write() for each header line of the SENT copy
+ * line - header line, ending in CR
+ */
+void sent_header(char *line) {
+  if (!strncmp(line, "Date: ", 6)) {
+    copyheader(hdrs.date, line + 6, 39);
+    hdrs.date[39] = '\0';
+  }
+  if (!strncmp(line, "From: ", 6)) {
+    copyheader(hdrs.from, line + 6, 79);
+    hdrs.from[79] = '\0';
+  }
+  if (!strncmp(line, "To: ", 4)) {
+    copyheader(hdrs.to, line + 4, 79);
+    hdrs.to[79] = '\0';
   }
+  if (!strncmp(line, "Cc: ", 4)) {
+    copyheader(hdrs.cc, line + 4, 79);
+    hdrs.cc[79] = '\0';
+  }
+  if (!strncmp(line, "Subject: ", 9)) {
+    copyheader(hdrs.subject, line + 9, 79);
+    hdrs.subject[79] = '\0';
+  }
+}
+
+/*
+ * Start the SENT copy of the message about to be sent
+ * The copy is written while the message is being sent, so each message
+ * is only read from OUTBOX once.
+ */
+void sent_start(void) {
+  sprintf(filename, "%s/SENT/EMAIL.%u", cfg_emaildir, nextemail);
+  if (sent_open(filename, linebuf, LINEBUFSZ, sent_header))
+    error_exit();
+  memset(&hdrs, 0, sizeof(hdrs));
   hdrs.emailnum = nextemail;
-  sprintf(filename, "%s/SENT/EMAIL.%u", cfg_emaildir, nextemail++);
-  puts(filename);
-  _filetype = PRODOS_T_TXT;
+  hdrs.status = 'N';
+  hdrs.tag = ' ';
+}
+
+/*
+ * Message was sent okay, add the SENT copy to the mailbox
+ */
+void sent_commit(void) {
+  hdrs.skipbytes = sent_close();
+  update_email_db(&hdrs);
+  write_next_email(++nextemail);
+}
+
+/*
+ * Read the time from the ProDOS clock, in minutes
+ * Months are taken to have 31 days, which is fine for comparing times.
+ * Returns 0 if there is no clock.
+ */
+uint32_t read_minutes(void) {
+  unsigned char *time = (unsigned char*)SYSTEMTIME;
+  uint16_t d, t, year;
+  uint8_t month, day, hour, minute;
+  gettime();
+  d = time[0] + 256U * time[1];
+  t = time[2] + 256U * time[3];
+  if ((d | t) == 0)
+    return 0;
+  if (!(t & 0xe000)) {
+    // ProDOS 1.0 to 2.4.2 date format
+    year = (d & 0xfe00) >> 9;
+    if (year < 40) // See ProDOS-8 Tech Note 48
+      year += 100;
+    month = (d & 0x01e0) >> 5;
+    day = d & 0x001f;
+    hour = (t & 0x1f00) >> 8;
+    minute = t & 0x003f;
+  } else {
+    // ProDOS 2.5.0+
+    year = (t & 0x0fff) - 1900;
+    month = ((t & 0xf000) >> 12) - 1;
+    day = (d & 0xf800) >> 11;
+    hour = (d & 0x07c0) >> 6;
+    minute = d & 0x003f;
+  }
+  return ((((uint32_t)year * 12 + month) * 31 + day) * 24 + hour) * 60 + minute;
+}
+
+/*
+ * Read OUTBOX/QUEUE.DB
+ */
+void queue_load(void) {
+  FILE *fp;
+  queuelen = 0;
+  queueloaded = 1;
+  sprintf(filename, "%s/OUTBOX/QUEUE.DB", cfg_emaildir);
+  fp = fopen(filename, "rb");
+  if (!fp)
+    return;
+  queuelen = fread(queue, sizeof(struct queueent), QUEUEMAX, fp);
+  fclose(fp);
+}
+
+/*
+ * Write OUTBOX/QUEUE.DB
+ * prune - if 1, drop entries for files which are no longer in OUTBOX
+ */
+void queue_save(uint8_t prune) {
+  FILE *fp;
+  uint8_t i;
+  if (!queueloaded)
+    return;
+  sprintf(filename, "%s/OUTBOX/QUEUE.DB", cfg_emaildir);
+  _filetype = PRODOS_T_BIN;
   _auxtype = 0;
-  destfp = fopen(filename, "wb");
-  if (!destfp) {
+  fp = fopen(filename, "wb");
+  if (!fp) {
     printf("Can't open %s\n", filename);
-    fclose(fp);
-    error_exit();
+    return;
   }
-  headers = 1;
-  headerchars = 0;
-  hdrs.skipbytes = 0; // Just in case it doesn't get set
-  hdrs.status = 'N';
-  hdrs.tag = ' ';
-  get_line(fp, 1, linebuf, LINEBUFSZ); // Reset buffer
-  while ((chars = get_line(fp, 0, linebuf, LINEBUFSZ)) != 0) {
-    if (headers) {
-      headerchars += chars;
-      if (!strncmp(linebuf, "Date: ", 6)) {
-        copyheader(hdrs.date, linebuf + 6, 39);
-        hdrs.date[39] = '\0';
-      }
-      if (!strncmp(linebuf, "From: ", 6)) {
-        copyheader(hdrs.from, linebuf + 6, 79);
-        hdrs.from[79] = '\0';
-      }
-      if (!strncmp(linebuf, "To: ", 4)) {
-        copyheader(hdrs.to, linebuf + 4, 79);
-        hdrs.to[79] = '\0';
-      }
-      if (!strncmp(linebuf, "Cc: ", 4)) {
-        copyheader(hdrs.cc, linebuf + 4, 79);
-        hdrs.cc[79] = '\0';
-      }
-      if (!strncmp(linebuf, "Subject: ", 9)) {
-        copyheader(hdrs.subject, linebuf + 9, 79);
-        hdrs.subject[79] = '\0';
+  for (i = 0; i < queuelen; ++i)
+    if (queue[i].name[0] && (seen[i] || !prune))
+      fwrite(&queue[i], sizeof(struct queueent), 1, fp);
+  fclose(fp);
+}
+
+/*
+ * Find the queue entry for a file in OUTBOX, adding it if not found
+ */
+struct queueent *queue_find(char *name) {
+  struct queueent *q;
+  uint8_t i;
+  for (i = 0; i < queuelen; ++i)
+    if (!strcmp(queue[i].name, name)) {
+      seen[i] = 1;
+      return &queue[i];
+    }
+  // Reuse an entry for a message which has gone
+  for (i = 0; i < queuelen; ++i)
+    if (!queue[i].name[0])
+      break;
+  if (i == QUEUEMAX)
+    q = &spare;
+  else {
+    q = &queue[i];
+    seen[i] = 1;
+    if (i == queuelen)
+      ++queuelen;
+  }
+  memset(q, 0, sizeof(struct queueent));
+  strncpy(q->name, name, sizeof(q->name) - 1);
+  q->state = 'Q';
+  return q;
+}
+
+/*
+ * Record failure to send message cur
+ * A temporary failure is retried later, waiting longer after each attempt.
+ * permanent - 1 if the server refused the message outright (5xx)
+ */
+void queue_fail(uint8_t permanent) {
+  struct queueent *q = cur;
+  uint8_t shift;
+  cur = NULL;
+  ++q->attempts;
+  strcpy(q->error, lasterr);
+  if (permanent || (q->attempts >= MAXTRIES)) {
+    q->state = 'F';
+    printf("Giving up, message left in OUTBOX\n");
+  } else {
+    q->state = 'R';
+    shift = (q->attempts > 6 ? 6 : q->attempts - 1);
+    q->retry = (now ? now + ((uint32_t)RETRYMINS << shift) : 0);
+    printf("Will retry later\n");
+  }
+  queue_save(0);
+}
+
+/*
+ * Record that message cur has been sent
+ */
+void queue_done(void) {
+  cur->name[0] = '\0';
+  cur = NULL;
+  queue_save(0);
+}
+
+/*
+ * Check whether an EHLO reply advertises an ESMTP extension
+ * reply - EHLO reply, one or more lines
+ * ext - name of extension
+ * Returns 1 if present, 0 otherwise
+ */
+uint8_t has_extension(char *reply, char *ext) {
+  uint8_t l = strlen(ext);
+  while (reply) {
+    if (!strncasecmp(reply + 4, ext, l) &&
+        ((reply[4 + l] == '\r') || (reply[4 + l] == ' ')))
+      return 1;
+    reply = strchr(reply, '\n');
+    if (reply)
+      ++reply;
+  }
+  return 0;
+}
+
+/*
+ * Send the envelope for a message: MAIL FROM, RCPT TO for each recipient,
+ * then DATA (unless the body is to be sent with BDAT).
+ * If the server supports PIPELINING, MAIL FROM and all the RCPT TO go out
+ * in one burst and the replies are then read back in order. Otherwise
+ * each command waits for its reply. DATA is only sent once every command
+ * has been accepted, so that the server never waits for a body which is
+ * not coming. If any recipient is refused, the message is not sent to
+ * anyone, and lasterr keeps the first refusal so the address shows up in
+ * the queue.
+ * recipients - comma-separated list of recipients (modified)
+ * Returns 0 if the server is ready for the message body, 1 to skip it for
+ * now (4xx), 2 to skip it because it can never be sent (5xx)
+ */
+uint8_t send_envelope(char *recipients) {
+  char *p, *q, *cmd = linebuf;
+  uint8_t err = 0;
+  char c;
+
+  // Build the commands in linebuf[], one per line
+  cmd += sprintf(cmd, "MAIL FROM:<%s>%s\r\n", cfg_emailaddr,
+                 (eightbit ? " BODY=8BITMIME" : ""));
+  p = recipients;
+  do {
+    q = strchr(p, ',');
+    if (q)
+      *q = '\0';
+    while (*p == ' ')
+      ++p;
+    if (*p) {
+      // Leave room for this RCPT TO and the null
+      if (cmd - linebuf + strlen(p) + 13 > LINEBUFSZ) {
+        printf("Too many recipients\n");
+        strcpy(lasterr, "Too many recipients");
+        return 2;
       }
-      if (linebuf[0] == '\r') {
-        headers = 0;
-        hdrs.skipbytes = headerchars;
+      cmd += sprintf(cmd, "RCPT TO:<%s>\r\n", p);
+    }
+    p = q + 1;
+  } while (q);
+
+  if (pipelining) {
+    for (p = linebuf; *p; p = strchr(p, '\n') + 1) {
+      putchar('>');
+      print_strip_crlf(p);
+    }
+    if (!w5100_send_text(linebuf))
+      error_exit();
+  }
+
+  for (p = linebuf; *p; p = q) {
+    q = strchr(p, '\n') + 1;
+    if (pipelining) {
+      if (!w5100_get_reply(buf, NETBUFSZ))
+        error_exit();
+    } else {
+      c = *q;
+      *q = '\0';
+      if (!w5100_tcp_send_recv(p, buf, NETBUFSZ, DO_SEND, CMD_MODE))
+        error_exit();
+      *q = c;
+    }
+    // Keep the first refusal, or the first permanent one if there is one
+    if (!err || ((err == 1) && (buf[0] == '5'))) {
+      if (expect(buf, "250 ")) {
+        err = (buf[0] == '5' ? 2 : 1);
+        if (!pipelining)
+          break;
       }
     }
-    fputs(linebuf, destfp);
   }
-  fclose(fp);
-  fclose(destfp);
-  update_email_db(&hdrs);
-  write_next_email(nextemail);
+  if (!err && !chunking) {
+    if (!w5100_tcp_send_recv("DATA\r\n", buf, NETBUFSZ, DO_SEND, CMD_MODE))
+      error_exit();
+    if (expect(buf, "354 "))
+      err = (buf[0] == '5' ? 2 : 1);
+  }
+  if (err) {
+    // Abandon this transaction, ready for the next message
+    if (!w5100_tcp_send_recv("RSET\r\n", buf, NETBUFSZ, DO_SEND, CMD_MODE))
+      error_exit();
+  }
+  return err;
+}
+
+#define BDAT_WINDOW 4 // Max BDAT chunks sent ahead of their replies
+
+/*
+ * Send the message body from file fp using BDAT (RFC 3030 CHUNKING)
+ * Each block of READSZ bytes read from the file is sent as one chunk.
+ * The chunk size must be given before the data, so crlf_size() first
+ * counts the line endings which will be expanded to CRLF. There is no
+ * dot-stuffing and no end of data marker, and 8 bit data is sent as is.
+ * If the server supports PIPELINING, up to BDAT_WINDOW chunks are sent
+ * before stopping to read their replies.
+ * Returns 0 if the message was accepted, 1 if it was refused
+ */
+uint8_t send_bdat(void) {
+  static char cmd[24];
+  uint16_t end;
+  uint8_t last, waiting = 0, err = 0;
+
+  filesize = 0;
+  w5100_crlf_start();
+  fseek(fp, 0, SEEK_SET);
+
+  do {
+    end = fread(buf, 1, READSZ, fp);
+    last = (end < READSZ);
+    if (sent_write((char*)buf, end))
+      error_exit();
+    filesize += end;
+    sprintf(cmd, "BDAT %u%s\r\n", crlf_size((char*)buf, end),
+            (last ? " LAST" : ""));
+    if (!w5100_send_text(cmd) || !w5100_send_crlf((char*)buf, end, 0))
+      error_exit();
+    spinner(filesize, 0);
+    ++waiting;
+    if (last || !pipelining || (waiting == BDAT_WINDOW)) {
+      // buf[] is free to hold the replies now the block has been sent
+      while (waiting) {
+        if (!w5100_get_reply(buf, NETBUFSZ))
+          error_exit();
+        err |= expect(buf, "250 ");
+        --waiting;
+      }
+    }
+  } while (!last && !err);
+  spinner(filesize, 1);
+  return err;
 }
 
 void main(int argc, char *argv[]) {
@@ -509,9 +776,19 @@ void main(int argc, char *argv[]) {
   struct dirent *d;
   char *p, *q, c;
   uint8_t eth_init = ETH_INIT_DEFAULT, connected = 0;
-
-  if ((argc == 2) && (strcmp(argv[1], "EMAIL") == 0))
-    exec_email_on_exit = 1;
+  uint8_t sent = 0, deferred = 0, err;
+
+  // EMAIL - return to EMAIL.SYSTEM on exit
+  // BATCH - send all messages which are due without asking
+  // SYNC  - as BATCH, then run the next program of a SYNC65 run
+  while (--argc) {
+    if (strcmp(argv[argc], "EMAIL") == 0)
+      exec_email_on_exit = 1;
+    else if (strcmp(argv[argc], "BATCH") == 0)
+      batch = 1;
+    else if (strcmp(argv[argc], "SYNC") == 0)
+      chained = batch = 1;
+  }
 
   videomode(VIDEOMODE_80COL);
   printf("%c%s SMTP%c\n", 0x0f, PROGNAME, 0x0e);
@@ -532,24 +809,32 @@ void main(int argc, char *argv[]) {
     }
   }
 
-  printf("%d\nInitializing %s     - ", eth_init, eth_name);
-  if (ip65_init(eth_init)) {
-    ip65_error_exit();
-  }
-
   // Abort on Ctrl-C to be consistent with Linenoise
   abort_key = 0x83;
 
-  printf("Ok\nObtaining IP address         - ");
-  if (dhcp_init()) {
-    ip65_error_exit();
+  if (chained && chain_net_load(&eth_init)) {
+    printf("%d\nUsing network from SYNC65    - Ok\n", eth_init);
+  } else {
+    printf("%d\nInitializing %s     - ", eth_init, eth_name);
+    if (ip65_init(eth_init)) {
+      ip65_error_exit();
+    }
+
+    printf("Ok\nObtaining IP address         - ");
+    if (dhcp_init()) {
+      ip65_error_exit();
+    }
+    printf("Ok\n");
   }
-  printf("Ok\n");
 
   // Copy IP config from IP65 to W5100
   w5100_init(eth_init);
   w5100_config();
 
+  read_next_email();
+  queue_load();
+  now = read_minutes();
+
   sprintf(filename, "%s/OUTBOX", cfg_emaildir);
   dp = opendir(filename);
   if (!dp) {
@@ -571,16 +856,26 @@ void main(int argc, char *argv[]) {
       goto skiptonext;
     if (!strncmp(d->d_name, "NEXT.EMAIL", 10))
       goto skiptonext;
+    if (!strncmp(d->d_name, "QUEUE.DB", 8))
+      goto skiptonext;
 
     printf("\n** Processing file %s ...\n", d->d_name);
 
+    cur = queue_find(d->d_name);
+    lasterr[0] = '\0';
+    if (cur->attempts)
+      printf("%u failed attempt(s), last error: %s\n", cur->attempts, cur->error);
+
     linecount = 0;
+    get_line(fp, 1, linebuf, LINEBUFSZ); // Reset buffer
     strcpy(recipients, "");
 
     while (1) {
       if ((get_line(fp, 0, linebuf, LINEBUFSZ) == 0) || (linecount == 20) || (linebuf[0] == '\r')) {
         if (strlen(recipients) == 0) {
           printf("No recipients (To or Cc) in %s. Skipping msg.\n", d->d_name);
+          strcpy(lasterr, "No recipients");
+          queue_fail(1);
           goto skiptonext;
         }
         break;
@@ -599,6 +894,23 @@ void main(int argc, char *argv[]) {
         printf("%s", linebuf);
     }
 
+    if (batch) {
+      if (cur->state == 'H') {
+        printf("Held, skipping msg\n");
+        goto skipqueued;
+      }
+      if (cur->state == 'F') {
+        printf("Failed, skipping msg\n");
+        goto skipqueued;
+      }
+      if ((cur->state == 'R') && now && (now < cur->retry)) {
+        printf("Not due for retry yet, skipping msg\n");
+        ++deferred;
+        goto skipqueued;
+      }
+      goto sendmessage;
+    }
+
     printf("\n%cS)end message | H)old message in OUTBOX | D)elete message from OUTBOX          %c",
            INVERSE, NORMAL);
     while (1) {
@@ -610,7 +922,11 @@ void main(int argc, char *argv[]) {
       case 'H':
       case 'h':
         printf("\n  Holding message\n");
+        cur->state = 'H';
+        queue_save(0);
+        cur = NULL;
         fclose(fp);
+        fp = NULL;
         goto skiptonext;
       case 'D':
       case 'd':
@@ -622,13 +938,21 @@ void main(int argc, char *argv[]) {
           case 'y':
             putchar(CLRLINE);
             printf("\n  Deleting message\n");
+            cur->name[0] = '\0';
+            queue_save(0);
+            cur = NULL;
             fclose(fp);
+            fp = NULL;
             goto unlink;
           case 'N':
           case 'n':
             putchar(CLRLINE);
             printf("\n  Holding message\n");
+            cur->state = 'H';
+            queue_save(0);
+            cur = NULL;
             fclose(fp);
+            fp = NULL;
             goto skiptonext;
           default:
             putchar(BELL);
@@ -658,72 +982,65 @@ sendmessage:
       if (expect(buf, "220 "))
         error_exit();
 
-      sprintf(sendbuf, "HELO %s\r\n", cfg_smtp_domain);
+      sprintf(sendbuf, "EHLO %s\r\n", cfg_smtp_domain);
       if (!w5100_tcp_send_recv(sendbuf, buf, NETBUFSZ, DO_SEND, CMD_MODE)) {
         error_exit();
       }
-      if (expect(buf, "250 "))
-        error_exit();
+      if (!strncmp(buf, "250", 3)) {
+        pipelining = has_extension(buf, "PIPELINING");
+        chunking = has_extension(buf, "CHUNKING");
+        eightbit = has_extension(buf, "8BITMIME");
+      } else {
+        // Not an ESMTP server
+        sprintf(sendbuf, "HELO %s\r\n", cfg_smtp_domain);
+        if (!w5100_tcp_send_recv(sendbuf, buf, NETBUFSZ, DO_SEND, CMD_MODE)) {
+          error_exit();
+        }
+        if (expect(buf, "250 "))
+          error_exit();
+      }
 
       connected = 1;
     }
 
-    sprintf(sendbuf, "MAIL FROM:<%s>\r\n", cfg_emailaddr);
-    if (!w5100_tcp_send_recv(sendbuf, buf, NETBUFSZ, DO_SEND, CMD_MODE)) {
-      error_exit();
-    }
-    if (expect(buf, "250 ")) {
-      printf("Skipping msg\n");
+    err = send_envelope(recipients);
+    if (err) {
+      ++deferred;
+      queue_fail(err == 2);
       goto skiptonext;
     }
 
-    // Handle multiple comma-separated recipients
-    p = recipients;
-    while (q = strchr(p, ',')) {
-      *q = '\0';
-      while (*p == ' ')
-        ++p;
-      sprintf(sendbuf, "RCPT TO:<%s>\r\n", p);
-      if (!w5100_tcp_send_recv(sendbuf, buf, NETBUFSZ, DO_SEND, CMD_MODE)) {
+    // SENT copy is written as the body goes out
+    sent_start();
+
+    if (chunking) {
+      if (send_bdat()) {
+        // Chunks already sent are discarded by RSET
+        w5100_tcp_send_recv("RSET\r\n", buf, NETBUFSZ, DO_SEND, CMD_MODE);
+        sent_abort();
+        ++deferred;
+        queue_fail(lasterr[0] == '5');
+        goto skiptonext;
+      }
+    } else {
+      if (!w5100_tcp_send_recv(sendbuf, buf, NETBUFSZ, DO_SEND, DATA_MODE)) {
         error_exit();
       }
       if (expect(buf, "250 ")) {
-        printf("Skipping msg\n");
+        sent_abort();
+        ++deferred;
+        queue_fail(lasterr[0] == '5');
         goto skiptonext;
       }
-      p = q + 1;
-    }
-    while (*p == ' ')
-      ++p;
-    sprintf(sendbuf, "RCPT TO:<%s>\r\n", p);
-    if (!w5100_tcp_send_recv(sendbuf, buf, NETBUFSZ, DO_SEND, CMD_MODE)) {
-      error_exit();
-    }
-    if (expect(buf, "250 ")) {
-      printf("Skipping msg\n");
-      goto skiptonext;
-    }
-
-    sprintf(sendbuf, "DATA\r\n");
-    if (!w5100_tcp_send_recv(sendbuf, buf, NETBUFSZ, DO_SEND, CMD_MODE)) {
-      error_exit();
-    }
-    if (expect(buf, "354 ")) {
-      printf("Skipping msg\n");
-      goto skiptonext;
     }
 
-    fseek(fp, 0, SEEK_SET);
-
-    if (!w5100_tcp_send_recv(sendbuf, buf, NETBUFSZ, DO_SEND, DATA_MODE)) {
-      error_exit();
-    }
-    expect(buf, "250 ");
-
     fclose(fp);
+    fp = NULL;
 
     printf("Updating SENT mailbox ...\n");
-    update_sent_mbox(d->d_name);
+    sent_commit();
+    queue_done();
+    ++sent;
 
     printf("Removing from OUTBOX ...\n");
     sprintf(filename, "%s/OUTBOX/%s", cfg_emaildir, d->d_name);
@@ -732,11 +1049,15 @@ unlink:
     if (unlink(filename))
       printf("Can't remove %s\n", filename);
 
+skipqueued:
+    cur = NULL;
+
 skiptonext:
     if (fp)
       fclose(fp);
   }
   closedir(dp);
+  queue_save(1);
 
   // Ignore any error - can be a race condition where other side
   // disconnects too fast and we get an error
@@ -744,7 +1065,10 @@ skiptonext:
     w5100_tcp_send_recv("QUIT\r\n", buf, NETBUFSZ, DO_SEND, CMD_MODE);
     printf("Disconnecting\n");
     w5100_disconnect();
-  } else
+  }
+  if (sent || deferred)
+    printf("\n** %u message(s) sent, %u left in OUTBOX **\n", sent, deferred);
+  else
     printf("\n** No messages were sent **\n");
 
   confirm_exit();
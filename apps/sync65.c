@@ -0,0 +1,119 @@
+/////////////////////////////////////////////////////////////////
+// SYNC65
+// Retrieve and send email and news in one go
+// Brings up the network once, then runs POP65, SMTP65, NNTP65
+// and NNTP65UP one after another. Each of them uses the network
+// settings left by SYNC65 rather than running DHCP again.
+/////////////////////////////////////////////////////////////////
+
+#include <cc65.h>
+#include <fcntl.h>
+#include <conio.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+
+#include "../inc/ip65.h"
+#include "w5100.h"
+
+#include "email_common.h"
+#include "chain.h"
+
+uint8_t exec_email_on_exit = 0;
+char    filename[80];
+
+/*
+ * Keypress before quit
+ */
+void confirm_exit(void) {
+  printf("\n[Press Any Key]");
+  cgetc();
+  if (exec_email_on_exit) {
+    sprintf(filename, "%s/EMAIL.SYSTEM", cfg_instdir);
+    exec(filename, NULL);
+  }
+  exit(0);
+}
+
+/*
+ * Called for all non IP65 errors
+ */
+void error_exit() {
+  confirm_exit();
+}
+
+/*
+ * Called if IP65 call fails
+ */
+void ip65_error_exit(void) {
+  printf("%s\n", ip65_strerror(ip65_error));
+  confirm_exit();
+}
+
+/*
+ * Read parms from EMAIL.CFG
+ * Only the install directory is needed here.
+ */
+void readconfigfile(void) {
+  FILE *fp = fopen("EMAIL.CFG", "r");
+  if (!fp) {
+    puts("Can't open config file EMAIL.CFG");
+    error_exit();
+  }
+  fscanf(fp, "%s%s%s%s%s%s%s", cfg_server, cfg_user, cfg_pass,
+                               cfg_pop_delete, cfg_smtp_server,
+                               cfg_smtp_domain, cfg_instdir);
+  fclose(fp);
+}
+
+void main(int argc, char *argv[]) {
+  uint8_t eth_init = ETH_INIT_DEFAULT;
+
+  if ((argc == 2) && (strcmp(argv[1], "EMAIL") == 0))
+    exec_email_on_exit = 1;
+
+  videomode(VIDEOMODE_80COL);
+  printf("%c%s Sync Email and News%c\n", 0x0f, PROGNAME, 0x0e);
+
+  printf("\nReading EMAIL.CFG            -");
+  readconfigfile();
+  printf(" Ok");
+
+  {
+    int file;
+
+    printf("\nSetting slot                 - ");
+    file = open("ethernet.slot", O_RDONLY);
+    if (file != -1) {
+      read(file, &eth_init, 1);
+      close(file);
+      eth_init &= ~'0';
+    }
+  }
+
+  printf("%d\nInitializing %s     - ", eth_init, eth_name);
+  if (ip65_init(eth_init)) {
+    ip65_error_exit();
+  }
+
+  // Abort on Ctrl-C to be consistent with Linenoise
+  abort_key = 0x83;
+
+  printf("Ok\nObtaining IP address         - ");
+  if (dhcp_init()) {
+    ip65_error_exit();
+  }
+  printf("Ok\n");
+
+  // Copy IP config from IP65 to W5100
+  w5100_init(eth_init);
+  w5100_config();
+
+  chain_net_save(eth_init);
+
+  // Does not return unless POP65 can't be loaded
+  chain_exec(cfg_instdir, CHAIN_POP, exec_email_on_exit);
+  printf("Can't run POP65\n");
+  error_exit();
+}
@@ -0,0 +1,145 @@
+; Direct 80 column text output for the enhanced Apple //e
+; Writes a whole row of text straight into the main and aux text pages,
+; bypassing the firmware COUT routine.
+; Requires 80STORE on, which is the case in 80 column mode.
+
+.export _putrow80, _putrow80sel, _copyrow80
+.import popa, popax
+.importzp ptr1, ptr2, tmp1, tmp2
+
+first	= tmp1			; First column shown inverse
+last	= tmp2			; Column after last one shown inverse
+
+TXTPAGE1 = $c054		; Display / write main memory text page
+TXTPAGE2 = $c055		; Display / write aux memory text page
+
+; void __fastcall__ putrow80(uint8_t row, uint8_t inverse, const char *s)
+; Displays the string s on the given screen row, padded with spaces
+; to 80 columns. Characters below $20 are shown as spaces.
+_putrow80:
+	sta ptr1			; s
+	stx ptr1+1
+	stz first
+	jsr popa			; inverse
+	cmp #$00
+	beq :+
+	lda #80				; Whole row
+:	sta last
+	bra rowarg
+
+; void __fastcall__ putrow80sel(uint8_t row, const char *s,
+;                               uint8_t first, uint8_t last)
+; As putrow80(), but only columns first to last-1 are shown inverse.
+_putrow80sel:
+	sta last
+	jsr popa			; first
+	sta first
+	jsr popax			; s
+	sta ptr1
+	stx ptr1+1
+rowarg:	jsr popa			; row
+	tax
+	lda rowlo,x			; Precomputed text row base address
+	sta ptr2
+	lda rowhi,x
+	sta ptr2+1
+
+	; Convert string to screen codes in rowbuf
+	ldy #$00
+conv:	lda (ptr1),y
+	beq pad				; End of string
+	and #$7f
+	cmp #$20
+	bcs :+
+	lda #$20			; Control char -> space
+:	ora #$80			; Normal video
+	cpy first
+	bcc store
+	cpy last
+	bcs store
+	cmp #$e0			; Lowercase?
+	bcs lower
+	and #$3f			; Inverse uppercase, digits, punctuation
+	bra store
+lower:	and #$7f			; Inverse lowercase (needs ALTCHARSET)
+store:	sta rowbuf,y
+	iny
+	cpy #80
+	bne conv
+	bra copy
+
+pad:	lda #$a0			; Normal space
+	cpy first
+	bcc :+
+	cpy last
+	bcs :+
+	lda #$20			; Inverse space
+:	sta rowbuf,y
+	iny
+	cpy #80
+	bne pad
+
+	; Even columns live in aux memory, odd columns in main memory
+copy:	bit TXTPAGE2
+	ldx #$00
+	ldy #$00
+auxlp:	lda rowbuf,x
+	sta (ptr2),y
+	inx
+	inx
+	iny
+	cpy #40
+	bne auxlp
+	bit TXTPAGE1
+	ldx #$01
+	ldy #$00
+mainlp:	lda rowbuf,x
+	sta (ptr2),y
+	inx
+	inx
+	iny
+	cpy #40
+	bne mainlp
+	rts
+
+; void __fastcall__ copyrow80(uint8_t dst, uint8_t src)
+; Copies screen row src to row dst, both the aux and main halves.
+; Used for scrolling part of the screen.
+_copyrow80:
+	tax				; src
+	lda rowlo,x
+	sta ptr1
+	lda rowhi,x
+	sta ptr1+1
+	jsr popa			; dst
+	tax
+	lda rowlo,x
+	sta ptr2
+	lda rowhi,x
+	sta ptr2+1
+	bit TXTPAGE2			; Even columns
+	ldy #39
+:	lda (ptr1),y
+	sta (ptr2),y
+	dey
+	bpl :-
+	bit TXTPAGE1			; Odd columns
+	ldy #39
+:	lda (ptr1),y
+	sta (ptr2),y
+	dey
+	bpl :-
+	rts
+
+; Base address of each text row on page 1
+rowlo:
+	.repeat 24, row
+	.byte <($0400 + (row .mod 8) * $80 + (row / 8) * $28)
+	.endrepeat
+rowhi:
+	.repeat 24, row
+	.byte >($0400 + (row .mod 8) * $80 + (row / 8) * $28)
+	.endrepeat
+
+.bss
+rowbuf:	.res 80